@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstring>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "batch.hh"
+
+#ifdef __AVX2__
+/* The wall heights of the four lanes at P, as doubles. */
+static inline __m256d load_walls(const uint8_t *p) {
+  int32_t four;
+  std::memcpy(&four, p, sizeof(four));
+  return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(four)));
+}
+#endif
+
+Batch::Batch(int lanes, uint64_t seed, int width, int height)
+    : lanes_{lanes},
+      stride_{(lanes + 3) / 4 * 4},
+      width_{width},
+      height_{height},
+      columns_{width - 2},
+      y_(stride_, height / 2.0),
+      dy_(stride_, Bird::kImpulse),
+      heights_(2 * columns_ * stride_),
+      alive_(words()),
+      starts_(stride_),
+      deaths_(stride_) {
+  random_.reserve(lanes);
+  for (int i = 0; i < lanes; i++) {
+    random_.emplace_back(seed + i);
+    alive_[i / 64] |= uint64_t{1} << (i % 64);
+  }
+}
+
+void Batch::restart(int i, uint64_t seed) {
+  y_[i] = height_ / 2.0;
+  dy_[i] = Bird::kImpulse;
+  for (int row = 0; row < 2 * columns_; row++) {
+    heights_[row * stride_ + i] = 0;
+  }
+  random_[i] = Random{seed};
+  alive_[i / 64] |= uint64_t{1} << (i % 64);
+  starts_[i] = steps_;
+}
+
+int Batch::living() const {
+  int count = 0;
+  for (uint64_t word : alive_) count += __builtin_popcountll(word);
+  return count;
+}
+
+/* Note that the birds of the four lanes from LANE whose bits are set
+ * in DEAD died on this step, if they hadn't already.
+ */
+inline void Batch::kill(int lane, unsigned dead) {
+  uint64_t &word = alive_[lane / 64];
+  for (uint64_t died = word >> (lane % 64) & dead; died; died &= died - 1) {
+    deaths_[lane + __builtin_ctzll(died)] = steps_;
+  }
+  word &= ~(uint64_t{dead} << (lane % 64));
+}
+
+void Batch::update(const uint64_t *pokes) {
+  steps_++;
+  if (steps_ % World::kRate == 0) {
+    scroll(steps_ % (World::kRate * World::kHGap));
+  }
+  const uint8_t *walls = column(width_ / 2 - 1);
+  int lane = 0;
+#ifdef __AVX2__
+  const __m256d impulse = _mm256_set1_pd(Bird::kImpulse);
+  const __m256d gravity = _mm256_set1_pd(Bird::kGravity);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d bottom = _mm256_set1_pd(height_);
+  const __m256d gap = _mm256_set1_pd(World::kVGap);
+  const __m256i select = _mm256_setr_epi64x(1, 2, 4, 8);
+  for (; lane < stride_; lane += 4) {
+    uint64_t bits = pokes[lane / 64] >> (lane % 64) & 0xf;
+    __m256i poke = _mm256_and_si256(_mm256_set1_epi64x(bits), select);
+    poke = _mm256_cmpeq_epi64(poke, select);
+    __m256d dy = _mm256_loadu_pd(&dy_[lane]);
+    dy = _mm256_blendv_pd(dy, impulse, _mm256_castsi256_pd(poke));
+    dy = _mm256_add_pd(dy, gravity);
+    __m256d y = _mm256_add_pd(_mm256_loadu_pd(&y_[lane]), dy);
+    _mm256_storeu_pd(&dy_[lane], dy);
+    _mm256_storeu_pd(&y_[lane], y);
+    __m256d wall = load_walls(walls + lane);
+    __m256d out = _mm256_or_pd(_mm256_cmp_pd(y, zero, _CMP_LE_OQ),
+                               _mm256_cmp_pd(y, bottom, _CMP_GE_OQ));
+    __m256d inside = _mm256_and_pd(
+        _mm256_cmp_pd(y, _mm256_sub_pd(wall, gap), _CMP_GT_OQ),
+        _mm256_cmp_pd(y, _mm256_add_pd(wall, gap), _CMP_LT_OQ));
+    __m256d hit = _mm256_andnot_pd(inside,
+                                   _mm256_cmp_pd(wall, zero, _CMP_NEQ_OQ));
+    kill(lane, _mm256_movemask_pd(_mm256_or_pd(out, hit)));
+  }
+#endif
+  for (; lane < stride_; lane++) {
+    if (pokes[lane / 64] >> (lane % 64) & 1) dy_[lane] = Bird::kImpulse;
+    dy_[lane] += Bird::kGravity;
+    y_[lane] += dy_[lane];
+    double y = y_[lane];
+    int wall = walls[lane];
+    bool dead = y <= 0 || y >= height_ ||
+                (wall != 0 && !(y > wall - World::kVGap &&
+                                y < wall + World::kVGap));
+    kill(lane, dead);
+  }
+}
+
+/* Move every lane's walls a column left, bringing in the column that
+ * World::step() would on step KIND of the walls' cycle.
+ */
+void Batch::scroll(int kind) {
+  uint8_t *row = &heights_[head_ * stride_];
+  switch (kind) {
+    case 0:
+      for (int i = 0; i < lanes_; i++) {
+        row[i] = World::rand_wall(random_[i], height_);
+      }
+      break;
+    case World::kRate * 1:
+    case World::kRate * 2:
+      std::memcpy(row, column(columns_ - 1), stride_);
+      break;
+    default:
+      std::memset(row, 0, stride_);
+  }
+  std::memcpy(row + columns_ * stride_, row, stride_);
+  head_ = head_ + 1 < columns_ ? head_ + 1 : 0;
+}
+
+void Batch::autopilot(uint64_t *pokes) const {
+  std::fill(pokes, pokes + words(), 0);
+  int first = width_ / 2 - 1, last = std::min(columns_, first + 10);
+  int lane = 0;
+#ifdef __AVX2__
+  const __m256d middle = _mm256_set1_pd(height_ / 2.0);
+  const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1);
+  for (; lane < stride_; lane += 4) {
+    __m256d target = middle, found = zero;
+    for (int i = first; i < last && _mm256_movemask_pd(found) != 0xf; i++) {
+      __m256d wall = load_walls(column(i) + lane);
+      __m256d take =
+          _mm256_andnot_pd(found, _mm256_cmp_pd(wall, zero, _CMP_NEQ_OQ));
+      target = _mm256_blendv_pd(target, wall, take);
+      found = _mm256_or_pd(found, take);
+    }
+    __m256d y = _mm256_loadu_pd(&y_[lane]);
+    unsigned bits = _mm256_movemask_pd(
+        _mm256_cmp_pd(y, _mm256_add_pd(target, one), _CMP_GT_OQ));
+    pokes[lane / 64] |= uint64_t{bits} << (lane % 64);
+  }
+#endif
+  for (; lane < stride_; lane++) {
+    double target = height_ / 2.0;
+    for (int i = first; i < last; i++) {
+      if (column(i)[lane] != 0) {
+        target = column(i)[lane];
+        break;
+      }
+    }
+    if (y_[lane] > target + 1) {
+      pokes[lane / 64] |= uint64_t{1} << (lane % 64);
+    }
+  }
+}
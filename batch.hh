@@ -0,0 +1,83 @@
+/* batch.hh --- many independent games stepped in lockstep
+ * This is free and unencumbered software released into the public domain.
+ */
+#ifndef FLAPPY_BATCH_HH
+#define FLAPPY_BATCH_HH
+
+#include <cstdint>
+#include <vector>
+#include "sim.hh"
+
+/* LANES games on the same board, lane I seeded SEED + I, advanced one
+ * tick at a time together. Each lane plays exactly as a Game with that
+ * seed would. The state is kept as structure of arrays: bird positions
+ * and velocities in one array per field, and the walls as a mirrored
+ * ring of columns (like Walls) holding one height per lane, so a tick
+ * works on four lanes per AVX2 instruction where that is available.
+ * Since all lanes take the same number of steps, the walls of every
+ * lane scroll together.
+ *
+ * Birds and poke requests are bitmaps with one bit per lane, 64 lanes
+ * to a word. Lanes go on ticking after their bird dies, but stay dead
+ * until a new game is started in them. That can only happen at the
+ * start of a wall cycle, so that the new game's walls scroll in step
+ * with the others.
+ */
+class Batch {
+ public:
+  Batch(int lanes, uint64_t seed, int width = kWidth, int height = kHeight);
+
+  int lanes() const { return lanes_; }
+
+  /* Words in the alive and poke bitmaps. */
+  int words() const { return (stride_ + 63) / 64; }
+
+  /* Advance every game a tick, as Game::update(), poking the birds
+   * whose bits are set in POKES.
+   */
+  void update(const uint64_t *pokes);
+
+  /* Set the bit in POKES of each bird autopilot() would poke. */
+  void autopilot(uint64_t *pokes) const;
+
+  /* The lanes whose birds are still alive. */
+  const uint64_t *alive() const { return alive_.data(); }
+  bool alive(int i) const { return alive_[i / 64] >> (i % 64) & 1; }
+  int living() const;
+
+  /* Steps lane I's game has taken, up to its bird's death. */
+  int steps(int i) const {
+    return (alive(i) ? steps_ : deaths_[i]) - starts_[i];
+  }
+
+  /* Lane I's score, final once its bird has died. */
+  int score(int i) const { return World::score(steps(i)); }
+
+  /* True if restart() may be called on this tick. */
+  bool can_restart() const {
+    return steps_ % (World::kRate * World::kHGap) == 0;
+  }
+
+  /* Start a new game seeded SEED in lane I, abandoning the old one. */
+  void restart(int i, uint64_t seed);
+
+ private:
+  const uint8_t *column(int i) const {
+    return &heights_[(head_ + i) * stride_];
+  }
+
+  void kill(int lane, unsigned dead);
+  void scroll(int kind);
+
+  int lanes_, stride_;  // lanes, and lanes rounded up to a whole vector
+  int width_, height_, columns_;
+  std::vector<double> y_, dy_;
+  std::vector<uint8_t> heights_;  // 2 * columns_ rows of stride_ lanes
+  std::vector<Random> random_;
+  std::vector<uint64_t> alive_;
+  std::vector<int> starts_, deaths_;  // the steps each lane's game
+                                     // started and its bird died on
+  int head_ = 0, steps_ = 0;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/* check.cc --- randomized checks of flappy's data structures
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Drives a TimingWheel with random schedule, cancel and advance
+ * sequences and compares it against a brute-force scan of every
+ * pending timer. Exits nonzero on the first disagreement.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "timer.hh"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                              \
+  do {                                                \
+    if (!(cond)) {                                    \
+      fprintf(stderr, "check: %s: ", #cond);          \
+      fprintf(stderr, __VA_ARGS__);                   \
+      fprintf(stderr, "\n");                          \
+      if (++failures > 10) exit(1);                   \
+    }                                                 \
+  } while (0)
+
+/* A timer along with the tick the reference model expects it to fire
+ * on, or 0 when it isn't pending.
+ */
+struct Probe : Timer {
+  uint64_t due = 0;
+};
+
+/* The earliest tick any pending probe is due, or kNever. */
+static uint64_t earliest(const std::vector<Probe> &probes) {
+  uint64_t next = TimingWheel::kNever;
+  for (const Probe &probe : probes) {
+    if (probe.due) next = std::min(next, probe.due);
+  }
+  return next;
+}
+
+static void check_wheel(uint64_t seed) {
+  std::mt19937_64 rng{seed};
+  TimingWheel wheel{rng() % 1000};
+  std::vector<Probe> probes(64);
+  for (int step = 0; step < 20000; step++) {
+    Probe &probe = probes[rng() % probes.size()];
+    uint64_t now = wheel.now();
+    switch (rng() % 8) {
+      case 0:
+      case 1:
+      case 2: {
+        /* Deadlines from the past to a few levels out. */
+        int bits = rng() % 20;
+        uint64_t delta = rng() & ((uint64_t{1} << bits) - 1);
+        uint64_t deadline = rng() % 4 ? now + delta : now - std::min(now, delta);
+        wheel.schedule(&probe, deadline);
+        probe.due = deadline > now ? deadline : now + 1;
+        break;
+      }
+      case 3:
+        wheel.cancel(&probe);
+        probe.due = 0;
+        break;
+      default: {
+        uint64_t to = now + rng() % (rng() % 4 ? 64 : 5000);
+        wheel.advance(to, [&](Timer *timer) {
+          Probe *fired = static_cast<Probe *>(timer);
+          CHECK(fired->due == wheel.now(),
+                "seed %" PRIu64 ": timer due at %" PRIu64 " fired at %" PRIu64,
+                seed, fired->due, wheel.now());
+          fired->due = 0;
+        });
+      }
+    }
+    uint64_t expect = earliest(probes);
+    uint64_t bound = wheel.next_deadline();
+    int pending = 0;
+    for (const Probe &p : probes) pending += p.due != 0;
+    CHECK(wheel.size() == pending, "seed %" PRIu64 ": size %d, expected %d",
+          seed, wheel.size(), pending);
+    CHECK(bound <= expect && bound > wheel.now(),
+          "seed %" PRIu64 ": next_deadline %" PRIu64 " at %" PRIu64
+          ", earliest pending %" PRIu64,
+          seed, bound, wheel.now(), expect);
+  }
+}
+
+/* The case that once hid a level-1 timer behind a later level-0 one. */
+static void check_levels() {
+  TimingWheel wheel{0};
+  Timer a, b;
+  wheel.schedule(&a, 130);
+  wheel.advance(100, [](Timer *) {});
+  wheel.schedule(&b, 163);
+  CHECK(wheel.next_deadline() <= 130, "next_deadline %" PRIu64,
+        wheel.next_deadline());
+}
+
+int main(int argc, char **argv) {
+  long seeds = argc > 1 ? atol(argv[1]) : 200;
+  check_levels();
+  for (long seed = 0; seed < seeds; seed++) check_wheel(seed);
+  if (failures) return 1;
+  printf("check: timing wheel agrees with brute force over %ld seeds\n",
+         seeds);
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <map>
+#include <memory>
+#include <mutex>
+#include "display.hh"
+
+WallStrips::WallStrips(int height)
+    : height_{height}, cells_(height * height, Cell{' ', 0}) {
+  for (int wall = 1; wall < height; wall++) {
+    Cell *strip = &cells_[wall * height];
+    for (int y = 1; y < height - 1; y++) {
+      if (y == wall - World::kVGap - 1 || y == wall + World::kVGap + 1) {
+        strip[y] = Cell{'=', pair(3)};
+      } else if (y < wall - World::kVGap || y > wall + World::kVGap) {
+        strip[y] = Cell{'|', pair(2)};
+      }
+    }
+  }
+}
+
+const WallStrips &WallStrips::get(int height) {
+  static std::mutex lock;
+  static std::map<int, std::unique_ptr<WallStrips>> cache;
+  std::lock_guard<std::mutex> guard{lock};
+  std::unique_ptr<WallStrips> &strips = cache[height];
+  if (!strips) strips.reset(new WallStrips{height});
+  return *strips;
+}
+
+/* Draw the cell of wall column I in row Y, blank or not. */
+static void draw_wall(Display &display, const World &world, int i, int y) {
+  display.screen.set(y, i + 1, display.walls.strip(world.walls[i])[y]);
+}
+
+/* Draw all of wall column I. */
+static void draw_column(Display &display, const World &world, int i) {
+  const Cell *strip = display.walls.strip(world.walls[i]);
+  for (int y = 1; y < display.height - 1; y++) {
+    display.screen.set(y, i + 1, strip[y]);
+  }
+}
+
+static void draw_score(Display &display, const World &world) {
+  Canvas &screen = display.screen;
+  screen.on(kBold);
+  screen.print(display.height, 0, "Score: %d", world.score());
+  screen.off(kBold);
+}
+
+void draw(Display &display, const World &world) {
+  for (int i = 0; i < world.walls.size(); i++) {
+    if (world.walls[i] != 0) draw_column(display, world, i);
+  }
+  draw_score(display, world);
+}
+
+void draw(Display &display, const Bird &bird, int c) {
+  display.screen.put(bird.row(display.height), display.width / 2, c);
+}
+
+void draw(Display &display, const Bird &bird) {
+  display.screen.on(pair(1) | kBold);
+  draw(display, bird, '@');
+  display.screen.off(pair(1) | kBold);
+}
+
+/* Draw a game frame. Unless the display was erased, only what changed
+ * since the previous frame is drawn: the walls are scrolled, the
+ * columns that moved into view and the cell the bird left are filled
+ * in, and the bird is drawn in its new row.
+ */
+void draw(Display &display, const Game &game) {
+  const World &world = game.world;
+  int n = world.scrolled - display.scrolled;
+  int columns = world.walls.size();
+  if (display.scrolled < 0 || n < 0 || n >= columns) {
+    display.erase();
+    draw(display, world);
+  } else {
+    if (n > 0) {
+      display.screen.shift(1, display.height - 1, 1, columns + 1, n);
+      for (int i = columns - n; i < columns; i++) {
+        draw_column(display, world, i);
+      }
+    }
+    int left = Bird::column(world) - 1 - n;  // where the bird was drawn
+    if (left >= 0) draw_wall(display, world, left, display.bird_row);
+    draw_score(display, world);
+  }
+  display.scrolled = world.scrolled;
+  display.bird_row = game.bird.row(world.height);
+  draw(display, game.bird);
+}
+
+void draw_title(Display &display, const Game &game) {
+  Canvas &screen = display.screen;
+  display.erase();
+  const char *title = "Flappy Curses", *version = "v" STR(VERSION),
+             *intro = "[Press SPACE to hop upwards]",
+               *url = "https://github.com/skeeto/flappy";
+  display.center(-3, title);
+  display.center(-2, version);
+  display.center(2, intro);
+  screen.on(pair(6) | kUnderline);
+  display.center(10, url);
+  screen.off(pair(6) | kUnderline);
+  draw(display, game.bird);
+}
+
+void draw_crash(Display &display, const Game &game) {
+  display.screen.on(pair(5) | kBold);
+  draw(display, game.bird, 'X');
+  display.screen.off(pair(5) | kBold);
+}
@@ -0,0 +1,225 @@
+/* display.hh --- flappy bird character display
+ * This is free and unencumbered software released into the public domain.
+ */
+#ifndef FLAPPY_DISPLAY_HH
+#define FLAPPY_DISPLAY_HH
+
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdarg>
+#include <cstring>
+#include "sim.hh"
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+/* Cell attributes. The low bits select one of the fixed color pairs. */
+enum : uint8_t { kPairMask = 0x07, kBold = 0x08, kUnderline = 0x10 };
+
+inline uint8_t pair(int n) { return n & kPairMask; }
+
+/* Foreground/background for each color pair, in ANSI color numbers. */
+struct ColorPair {
+  uint8_t fg, bg;
+};
+
+enum { kBlack, kRed, kGreen, kYellow, kBlue, kMagenta, kCyan, kWhite };
+
+static constexpr ColorPair kPairs[] = {
+    {kWhite, kBlack},   {kYellow, kBlack}, {kGreen, kBlack}, {kGreen, kGreen},
+    {kYellow, kBlack},  {kRed, kBlack},    {kCyan, kBlack},
+};
+
+struct Cell {
+  char ch;
+  uint8_t attr;
+};
+
+inline bool operator==(Cell a, Cell b) {
+  return a.ch == b.ch && a.attr == b.attr;
+}
+inline bool operator!=(Cell a, Cell b) { return !(a == b); }
+
+/* An off-screen character grid with a small curses-like drawing API.
+ * It keeps track of what changed since the last clean(), so a renderer
+ * only has to look there.
+ */
+struct Canvas {
+  Canvas(int width, int height)
+      : width{width},
+        height{height},
+        cells(width * height, Cell{' ', 0}),
+        damage(height, Span{width, 0}) {}
+
+  /* Columns LO up to HI of a row, or nothing when LO >= HI. */
+  struct Span {
+    int lo, hi;
+  };
+
+  /* A shift() since the last clean(), or a zero COUNT. */
+  struct Scroll {
+    int top, bottom, left, right, count;
+  };
+
+  const int width, height;
+  std::vector<Cell> cells;
+  std::vector<Span> damage;  // per row, the columns written since clean()
+  Scroll scrolled = {0, 0, 0, 0, 0};
+  uint8_t attr = 0;
+  int cursor_y = 0, cursor_x = 0;
+  bool cursor = false;
+
+  const Cell &at(int y, int x) const { return cells[y * width + x]; }
+
+  void set(int y, int x, Cell cell) {
+    Cell &old = cells[y * width + x];
+    if (old != cell) {
+      old = cell;
+      Span &span = damage[y];
+      span.lo = std::min(span.lo, x);
+      span.hi = std::max(span.hi, x + 1);
+    }
+  }
+
+  void on(uint8_t a) {
+    if (a & kPairMask) attr &= ~kPairMask;
+    attr |= a;
+  }
+
+  void off(uint8_t a) {
+    if (a & kPairMask) attr &= ~kPairMask;
+    attr &= ~(a & ~kPairMask);
+  }
+
+  void seek(int y, int x) {
+    cursor_y = y;
+    cursor_x = x;
+  }
+
+  void put(int c) {
+    if (cursor_y >= 0 && cursor_y < height && cursor_x >= 0 &&
+        cursor_x < width) {
+      set(cursor_y, cursor_x, Cell{static_cast<char>(c), attr});
+    }
+    cursor_x++;
+  }
+
+  void put(int y, int x, int c) {
+    seek(y, x);
+    put(c);
+  }
+
+  void print(int y, int x, const char *format, ...) {
+    char buffer[256];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(buffer, sizeof(buffer), format, ap);
+    va_end(ap);
+    seek(y, x);
+    for (char *p = buffer; *p; p++) put(*p);
+  }
+
+  void clear_eol() {
+    for (int x = cursor_x; x < width; x++) set(cursor_y, x, Cell{' ', 0});
+  }
+
+  void blank() {
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) set(y, x, Cell{' ', 0});
+    }
+  }
+
+  /* Move columns LEFT up to RIGHT of rows TOP up to BOTTOM left by N,
+   * blanking the N columns uncovered at the right.
+   */
+  void shift(int top, int bottom, int left, int right, int n) {
+    for (int y = top; y < bottom; y++) {
+      Cell *row = &cells[y * width];
+      std::copy(row + left + n, row + right, row + left);
+      std::fill(row + right - n, row + right, Cell{' ', 0});
+      Span &span = damage[y];
+      if (span.lo < right && span.hi > left) {
+        span = Span{0, width};  // earlier writes moved
+      }
+    }
+    scrolled = Scroll{top, bottom, left, right, scrolled.count + n};
+  }
+
+  /* Forget the damage, once a renderer has caught up. */
+  void clean() {
+    std::fill(damage.begin(), damage.end(), Span{width, 0});
+    scrolled.count = 0;
+  }
+};
+
+/* The cells of a wall column for each gap position on a board of some
+ * height, built once per height and shared by every display.
+ */
+class WallStrips {
+ public:
+  static const WallStrips &get(int height);
+
+  /* Rows of a column whose gap is centered on row WALL, or of an empty
+   * column when WALL is 0.
+   */
+  const Cell *strip(int wall) const { return &cells_[wall * height_]; }
+
+ private:
+  explicit WallStrips(int height);
+
+  int height_;
+  std::vector<Cell> cells_;
+};
+
+struct Display {
+  Display(int width = kWidth, int height = kHeight)
+      : height{height},
+        width{width},
+        screen{width + 40, height + 4},
+        walls(WallStrips::get(height)) {
+    erase();
+  }
+
+  const int height, width;
+  Canvas screen;
+  const WallStrips &walls;
+
+  /* The World::scrolled and bird row last drawn, so that the next game
+   * frame only has to draw what changed. Negative after an erase().
+   */
+  int scrolled = -1, bird_row = -1;
+
+  void erase() {
+    scrolled = bird_row = -1;
+    screen.blank();
+    for (int y = 0; y < height; y++) {
+      screen.put(y, 0, '|');
+      screen.put(y, width - 1, '|');
+    }
+    for (int x = 0; x < width; x++) {
+      screen.put(0, x, '-');
+      screen.put(height - 1, x, '-');
+    }
+    screen.put(0, 0, '/');
+    screen.put(height - 1, 0, '\\');
+    screen.put(0, width - 1, '\\');
+    screen.put(height - 1, width - 1, '/');
+  }
+
+  void center(int yoff, const char *str) {
+    screen.print(height / 2 + yoff, width / 2 - std::strlen(str) / 2, "%s",
+                 str);
+  }
+};
+
+/* Drawing the simulation onto a display. */
+void draw(Display &display, const World &world);
+void draw(Display &display, const Bird &bird, int c);
+void draw(Display &display, const Bird &bird);
+void draw(Display &display, const Game &game);
+void draw_title(Display &display, const Game &game);
+void draw_crash(Display &display, const Game &game);
+
+#endif
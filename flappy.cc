@@ -2,22 +2,26 @@
  * This is free and unencumbered software released into the public domain.
  */
 
-#include <algorithm>
 #include <thread>
-#include <deque>
-#include <ctime>
-#include <cmath>
+#include <cerrno>
 #include <cstring>
+#include <cstdlib>
 #include <ncurses.h>
+#include <poll.h>
+#include <termios.h>
 #include <unistd.h>
 #include "sqlite3.h"
 #include "highscores.hh"
-
-#define STR_(x) #x
-#define STR(x) STR_(x)
-
-struct Display {
-  Display(int width = 40, int height = 20) : height{height}, width{width} {
+#include "game.hh"
+#include "keys.hh"
+#include "output.hh"
+#include "pacing.hh"
+#include "renderer.hh"
+#include "server.hh"
+
+/* Shows a session's canvas on the controlling terminal via ncurses. */
+struct CursesTerminal {
+  CursesTerminal() {
     initscr();
     start_color();
     raw();
@@ -25,320 +29,249 @@ struct Display {
     noecho();
     curs_set(0);
     keypad(stdscr, TRUE);
-    erase();
+    for (size_t i = 1; i < sizeof(kPairs) / sizeof(kPairs[0]); i++) {
+      init_pair(i, kPairs[i].fg, kPairs[i].bg);
+    }
   }
 
-  ~Display() {
+  ~CursesTerminal() {
     endwin();
     fflush(stdout);
   }
 
-  void erase() {
-    ::erase();
-    for (int y = 0; y < height; y++) {
-      mvaddch(y, 0, '|');
-      mvaddch(y, width - 1, '|');
-    }
-    for (int x = 0; x < width; x++) {
-      mvaddch(0, x, '-');
-      mvaddch(height - 1, x, '-');
+  void present(Canvas &screen) {
+    for (int y = 0; y < screen.height; y++) {
+      for (int x = 0; x < screen.width; x++) {
+        Cell cell = screen.at(y, x);
+        chtype attr = COLOR_PAIR(cell.attr & kPairMask);
+        if (cell.attr & kBold) attr |= A_BOLD;
+        if (cell.attr & kUnderline) attr |= A_UNDERLINE;
+        mvaddch(y, x, static_cast<unsigned char>(cell.ch) | attr);
+      }
     }
-    mvaddch(0, 0, '/');
-    mvaddch(height - 1, 0, '\\');
-    mvaddch(0, width - 1, '\\');
-    mvaddch(height - 1, width - 1, '/');
+    curs_set(screen.cursor);
+    if (screen.cursor) move(screen.cursor_y, screen.cursor_x);
+    refresh();
+    screen.clean();
   }
 
-  void refresh() { ::refresh(); }
-
-  const int height, width;
-
-  int block_getch() {
-    refresh();
-    timeout(-1);
+  int key() {
     int c = getch();
-    timeout(0);
+    switch (c) {
+      case ERR:
+        return kNoKey;
+      case KEY_ENTER:
+        return '\n';
+      case KEY_LEFT:
+      case KEY_BACKSPACE:
+        return kKeyBackspace;
+    }
     return c;
   }
 
-  bool read_name(int y, int x, char *target, size_t n) {
-    int p = 0;
+  int block_getch() {
     timeout(-1);
-    curs_set(1);
-    init_pair(4, COLOR_YELLOW, COLOR_BLACK);
-    int style = A_BOLD | A_UNDERLINE | COLOR_PAIR(4);
-    attron(style);
-    bool reading = true, cancelled = false;
-    while (reading) {
-      move(y, x + p);
-      refresh();
-      int c = getch();
-      switch (c) {
-        case '':
-          cancelled = true;
-        case KEY_ENTER:
-        case '\n':
-        case '\r':
-        case ERR:
-          reading = false;
-          break;
-        case KEY_LEFT:
-        case KEY_BACKSPACE:
-          attroff(style);
-          if (p > 0) mvaddch(y, x + --p, ' ');
-          attron(style);
-          break;
-        case ' ':
-          if (p == 0) {
-            break;
-          }
-        default:
-          if (p < n - 1) {
-            target[p] = c;
-            mvaddch(y, x + p++, c);
-          }
-      }
-    }
-    target[p + 1] = '\0';
-    attroff(style);
+    int c = key();
     timeout(0);
-    curs_set(0);
-    return !cancelled;
-  }
-
-  void center(int yoff, const char *str) {
-    mvprintw(height / 2 + yoff, width / 2 - std::strlen(str) / 2, "%s", str);
+    return c == kNoKey ? kKeyHangup : c;
   }
 };
 
-bool is_exit(int c) { return c == 'q' || c == ''; }
-
-struct World {
-  World(Display *display) : display{display} {
-    for (int x = 1; x < display->width - 1; x++) {
-      walls.push_back(0);
-    }
+/* Shows a session's canvas on the controlling terminal with plain ANSI
+ * escape sequences, without terminfo or ncurses.
+ */
+class AnsiTerminal {
+ public:
+  AnsiTerminal() : renderer_{STDOUT_FILENO} {
+    tcgetattr(STDIN_FILENO, &saved_);
+    termios raw = saved_;
+    cfmakeraw(&raw);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    print("\x1b[?1049h");  // alternate screen
   }
 
-  std::deque<int> walls;
-  Display *display;
-  int steps = 0;
-
-  constexpr static int kRate = 2, kVGap = 2, kHGap = 10;
-
-  int rand_wall() {
-    int h = display->height;
-    return (rand() % h / 2) + h / 4;
+  ~AnsiTerminal() {
+    print("\x1b[0m\x1b[?25h\x1b[?1049l");
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_);
   }
 
-  void step() {
-    steps++;
-    if (steps % kRate == 0) {
-      walls.pop_front();
-      switch (steps % (kRate * kHGap)) {
-        case 0:
-          walls.push_back(rand_wall());
-          break;
-        case kRate * 1:
-        case kRate * 2:
-          walls.push_back(walls.back());
-          break;
-        default:
-          walls.push_back(0);
-      }
-    }
-  }
+  void present(Canvas &screen) { renderer_.present(screen); }
 
-  void draw() {
-    init_pair(2, COLOR_GREEN, COLOR_BLACK);
-    init_pair(3, COLOR_GREEN, COLOR_GREEN);
-    attron(COLOR_PAIR(2));
-    for (int i = 0; i < walls.size(); i++) {
-      int wall = walls[i];
-      if (wall != 0) {
-        for (int y = 1; y < display->height - 1; y++) {
-          if (y == wall - kVGap - 1 || y == wall + kVGap + 1) {
-            attroff(COLOR_PAIR(2));
-            attron(COLOR_PAIR(3));
-            mvaddch(y, i + 1, '=');
-            attroff(COLOR_PAIR(3));
-            attron(COLOR_PAIR(2));
-          } else if (y < wall - kVGap || y > wall + kVGap) {
-            mvaddch(y, i + 1, '|');
-          }
-        }
-      }
+  int key() {
+    unsigned char c;
+    while (read(STDIN_FILENO, &c, 1) == 1) {
+      int key = keys_.decode(c);
+      if (key != kNoKey) return key;
     }
-    attroff(COLOR_PAIR(2));
-    attron(A_BOLD);
-    mvprintw(display->height, 0, "Score: %d", score());
-    attroff(A_BOLD);
+    return kNoKey;
   }
 
-  int score() { return std::max(0, (steps - 2) / (kRate * kHGap) - 2); }
-};
-
-struct Bird {
-  Bird(Display *display) : y{display->height / 2.0}, display{display} {}
-
-  static constexpr double kImpulse = -0.8, kGravity = 0.1;
-
-  double y, dy = kImpulse;
-  Display *display;
-
-  void gravity() {
-    dy += kGravity;
-    y += dy;
-  }
-
-  void poke() { dy = kImpulse; }
-
-  void draw() {
-    init_pair(1, COLOR_YELLOW, COLOR_BLACK);
-    attron(COLOR_PAIR(1) | A_BOLD);
-    draw('@');
-    attroff(COLOR_PAIR(1) | A_BOLD);
+  int block_getch() {
+    while (true) {
+      pollfd fds = {STDIN_FILENO, POLLIN, 0};
+      if (poll(&fds, 1, -1) < 0 && errno != EINTR) return kKeyHangup;
+      int c = key();
+      if (c != kNoKey) return c;
+      if (fds.revents & (POLLHUP | POLLERR)) return kKeyHangup;
+    }
   }
 
-  void draw(int c) {
-    int h = std::round(y);
-    h = std::max(1, std::min(h, display->height - 2));
-    mvaddch(h, display->width / 2, c);
+ private:
+  static void print(const char *s) {
+    if (write(STDOUT_FILENO, s, std::strlen(s)) < 0) perror("flappy");
   }
 
-  bool is_alive(World &world) {
-    if (y <= 0 || y >= display->height) {
-      return false;
-    }
-    int wall = world.walls[display->width / 2 - 1];
-    if (wall != 0) {
-      return y > wall - World::kVGap && y < wall + World::kVGap;
-    }
-    return true;
-  }
+  termios saved_;
+  AnsiRenderer renderer_;
+  KeyDecoder keys_;
 };
 
-struct Game {
-  Game(Display *display) : display{display}, bird{display}, world{display} {}
-
-  Display *display;
-  Bird bird;
-  World world;
+/* Frames drawn by the local game, and the time spent drawing them. */
+struct DrawStats {
+  uint64_t frames = 0, ns = 0;
+};
 
-  int run() {
-    display->erase();
-    const char *title = "Flappy Curses", *version = "v" STR(VERSION),
-               *intro = "[Press SPACE to hop upwards]",
-                 *url = "https://github.com/skeeto/flappy";
-    display->center(-3, title);
-    display->center(-2, version);
-    display->center(2, intro);
-    init_pair(6, COLOR_CYAN, COLOR_BLACK);
-    attron(COLOR_PAIR(6) | A_UNDERLINE);
-    display->center(10, url);
-    attroff(COLOR_PAIR(6) | A_UNDERLINE);
-    bird.draw();
-    if (is_exit(display->block_getch())) return -1;
-    while (bird.is_alive(world)) {
-      int c = getch();
-      if (is_exit(c)) {
-        return -1;
-      } else if (c != ERR) {
-        while (getch() != ERR)
+/* Run a session on a local terminal until the player quits. */
+template <typename Terminal>
+static void play(Session &session, Rates rates, Pacer &pacer,
+                 DrawStats &stats) {
+  Terminal terminal;
+  uint64_t tick = rates.tick.count(), lag = 0, last = 0;
+  int max_ticks = rates.max_ticks();
+  int skipped = 0;
+  while (session.state != Session::kQuit) {
+    if (session.state == Session::kPlay) {
+      int c = terminal.key();
+      if (c != kNoKey) {
+        while (terminal.key() != kNoKey)
           ;  // clear repeat buffer
-        bird.poke();
+        session.key(c);
       }
-      display->erase();
-      world.step();
-      world.draw();
-      bird.gravity();
-      bird.draw();
-      display->refresh();
-      std::this_thread::sleep_for(std::chrono::milliseconds{67});
+
+      /* Run the simulation ticks that came due, then draw one frame
+       * unless the terminal is too slow to keep up.
+       */
+      uint64_t now = monotonic_ns();
+      lag += now - last;
+      last = now;
+      for (int i = 0; lag >= tick && session.state == Session::kPlay; i++) {
+        if (i == max_ticks) {
+          lag = 0;
+          break;
+        }
+        session.tick();
+        lag -= tick;
+      }
+      if (!pacer.behind() || ++skipped > kMaxTicksPerFrame) {
+        uint64_t start = monotonic_ns();
+        session.draw();
+        terminal.present(session.display.screen);
+        stats.ns += monotonic_ns() - start;
+        stats.frames++;
+        skipped = 0;
+      }
+      pacer.wait();
+    } else {
+      terminal.present(session.display.screen);
+      session.key(terminal.block_getch());
+      pacer.start();
+      last = monotonic_ns();
+      lag = tick;  // the first tick is due right away
     }
-    init_pair(5, COLOR_RED, COLOR_BLACK);
-    attron(COLOR_PAIR(5) | A_BOLD);
-    bird.draw('X');
-    attroff(COLOR_PAIR(5) | A_BOLD);
-    display->refresh();
-    return world.score();
   }
-};
+}
 
-void print_scores(Display &display, HighScores &scores) {
-  attron(A_BOLD);
-  mvprintw(0, display.width + 4, "== High Scores ==");
-  attroff(A_BOLD);
-  int i = 1;
-  for (auto &line : scores.top_scores()) {
-    mvprintw(i, display.width + 1, "%s", line.name.c_str());
-    clrtoeol();
-    mvprintw(i, display.width + 24, "%d", line.score);
-    i++;
-  }
+/* Parse a rate in Hz into a period. */
+static std::chrono::nanoseconds hertz(const char *arg) {
+  double hz = std::max(1.0, std::min(atof(arg), 1000.0));
+  return std::chrono::nanoseconds{static_cast<long long>(1e9 / hz)};
 }
 
 int main(int argc, char **argv) {
-  srand(std::time(NULL));
-
   /* Parse command line arguments. */
   int opt;
-  const char *filename = "/tmp/flappy-scores.db", *host = "localhost";
-  while ((opt = getopt(argc, argv, "d:h:p")) != -1) {
+  const char *filename = "/tmp/flappy-scores.db", *host = "localhost",
+             *port = nullptr;
+  int threads = std::thread::hardware_concurrency(), interval = -1;
+  int compress = -1;
+  bool ansi = false, uring = false;
+  Rates rates;
+  while ((opt = getopt(argc, argv, "ad:f:h:j:l:ps:t:uz:")) != -1) {
     switch (opt) {
+      case 'a':
+        ansi = true;
+        break;
       case 'd':
         filename = optarg;
         break;
+      case 'f':
+        rates.frame = hertz(optarg);
+        break;
       case 'h':
         host = optarg;
         break;
+      case 'j':
+        threads = std::max(1, atoi(optarg));
+        break;
+      case 'l':
+        port = optarg;
+        break;
       case 'p':  // ignore
         break;
+      case 's':
+        interval = atoi(optarg);
+        break;
+      case 't':
+        rates.tick = hertz(optarg);
+        break;
+      case 'u':
+        uring = true;
+        break;
+      case 'z':
+        if (!strcmp(optarg, "partial")) {
+          compress = Output::kPartial;
+        } else if (!strcmp(optarg, "sync")) {
+          compress = Output::kSync;
+        } else if (!strcmp(optarg, "full")) {
+          compress = Output::kFull;
+        }
+        break;
     }
   }
 
-  Display display;
-  HighScores scores{filename, display.height - 1};
+  /* A server checks high scores on their own threads; the local game
+   * checks its own before showing the table.
+   */
+  HighScores scores{filename, kHeight - 1, port ? std::max(1, threads) : 0};
 
-  while (true) {
-    Game game{&display};
-
-    int score = game.run();
-    if (score < 0) {
-      return 0;  // game quit early
-    }
-
-    /* Game over */
-    mvprintw(display.height + 1, 0, "Game over!");
-    print_scores(display, scores);
-
-    /* Enter new high score */
-    if (scores.is_best(score)) {
-      attron(A_BOLD);
-      mvprintw(display.height + 2, 0, "You have a high score!");
-      mvprintw(display.height + 3, 0, "Enter name: ");
-      attroff(A_BOLD);
-      char name[23] = {0};
-      if (!display.read_name(display.height + 3, 12, name, sizeof(name))) {
-        return 0;
-      }
-      if (std::strlen(name) == 0) {
-        std::strcpy(name, "(anonymous)");
-      }
-      scores.insert_score(name, score);
-      move(display.height + 3, 0);
-      clrtoeol();
-      print_scores(display, scores);
-    }
+  if (port != nullptr) {
+    Server server{host, port, &scores, std::max(1, threads),
+                  interval < 0 ? 60 : interval, rates, uring, compress};
+    return server.run();
+  }
 
-    /* Handle quit/restart */
-    mvprintw(display.height + 2, 0, "Press 'q' to quit, 'r' to retry.");
-    int c;
-    while ((c = display.block_getch()) != 'r') {
-      if (is_exit(c) || c == ERR) {
-        return 0;
-      }
-    }
+  uint64_t start = monotonic_ns();
+  Pacer pacer{rates.frame};
+  DrawStats stats;
+  Session session{&scores};
+  if (ansi) {
+    play<AnsiTerminal>(session, rates, pacer, stats);
+  } else {
+    play<CursesTerminal>(session, rates, pacer, stats);
+  }
+  if (interval > 0) {
+    double seconds = (monotonic_ns() - start) / 1e9;
+    fprintf(stderr, "flappy: ");
+    pacer.lateness.report(stderr);
+    fprintf(stderr, ", %llu resyncs\n", (unsigned long long)pacer.resyncs);
+    fprintf(stderr, "flappy: %llu frames drawn in %.0fns each\n",
+            (unsigned long long)stats.frames,
+            stats.frames ? (double)stats.ns / stats.frames : 0);
+    fprintf(stderr, "flappy: scores: ");
+    scores.verifier().report(stderr, seconds);
+    fprintf(stderr, "\n");
   }
   return 0;
 }
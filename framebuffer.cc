@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <cstdio>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "framebuffer.hh"
+
+/* Stands in for the character of a cell whose contents the terminal
+ * may not show as remembered. No canvas holds it, so the cell always
+ * differs from what should be there.
+ */
+static const char kUnknown = '\0';
+
+/* Rewriting up to this many unchanged cells beats any cursor motion. */
+static const int kMaxReprint = 3;
+
+/* Scrolling a row costs about as many bytes as repainting this many
+ * scattered cells.
+ */
+static const int kScrollCost = 4;
+
+/* SGR parameters, as text. */
+struct Params {
+  char text[32];
+  int length = 0;
+
+  void add(int n) {
+    if (length) text[length++] = ';';
+    if (n >= 10) text[length++] = '0' + n / 10;
+    text[length++] = '0' + n % 10;
+  }
+};
+
+static int foreground(int attr) {
+  return attr & kPairMask ? 30 + kPairs[attr & kPairMask].fg : 39;
+}
+
+static int background(int attr) {
+  return attr & kPairMask ? 40 + kPairs[attr & kPairMask].bg : 49;
+}
+
+/* Length of the SGR sequence selecting ATTR from scratch. */
+static int sgr_length(uint8_t attr) {
+  return 4 + (attr & kBold ? 2 : 0) + (attr & kUnderline ? 2 : 0) +
+         (attr & kPairMask ? 6 : 0);
+}
+
+/* Append the SGR sequence switching from attribute FROM (negative if
+ * unknown) to TO: only the parameters that differ, or a reset and all
+ * of TO, whichever is shorter. Returns the bytes appended.
+ */
+static int sgr(std::string &out, int from, uint8_t to) {
+  Params reset, delta;
+  reset.add(0);
+  if (to & kBold) reset.add(1);
+  if (to & kUnderline) reset.add(4);
+  if (to & kPairMask) {
+    reset.add(foreground(to));
+    reset.add(background(to));
+  }
+  const Params *params = &reset;
+  if (from >= 0) {
+    if ((from ^ to) & kBold) delta.add(to & kBold ? 1 : 22);
+    if ((from ^ to) & kUnderline) delta.add(to & kUnderline ? 4 : 24);
+    if (foreground(from) != foreground(to)) delta.add(foreground(to));
+    if (background(from) != background(to)) delta.add(background(to));
+    if (delta.length == 0) return 0;  // pairs with the same colors
+    if (delta.length <= reset.length) params = &delta;
+  }
+  out += "\x1b[";
+  out.append(params->text, params->length);
+  out += 'm';
+  return params->length + 3;
+}
+
+/* Set bit X of DIRTY for each of the first N cells where A and B
+ * differ. Vector compares cover 16 or 32 cells at a time, packing the
+ * 16-bit cell comparisons down to one bit per cell.
+ */
+static void compare(const Cell *a, const Cell *b, int n, uint64_t *dirty) {
+  static_assert(sizeof(Cell) == 2, "cells are compared as 16-bit lanes");
+  std::fill(dirty, dirty + (n + 63) / 64, 0);
+  int x = 0;
+#ifdef __AVX2__
+  for (; x + 32 <= n; x += 32) {
+    const __m256i *p = reinterpret_cast<const __m256i *>(a + x);
+    const __m256i *q = reinterpret_cast<const __m256i *>(b + x);
+    __m256i lo = _mm256_cmpeq_epi16(_mm256_loadu_si256(p),
+                                    _mm256_loadu_si256(q));
+    __m256i hi = _mm256_cmpeq_epi16(_mm256_loadu_si256(p + 1),
+                                    _mm256_loadu_si256(q + 1));
+    __m256i same = _mm256_packs_epi16(lo, hi);  // interleaves the lanes
+    same = _mm256_permute4x64_epi64(same, 0xd8);
+    uint32_t bits = ~_mm256_movemask_epi8(same);
+    dirty[x / 64] |= uint64_t{bits} << (x % 64);
+  }
+#endif
+#ifdef __SSE2__
+  for (; x + 16 <= n; x += 16) {
+    const __m128i *p = reinterpret_cast<const __m128i *>(a + x);
+    const __m128i *q = reinterpret_cast<const __m128i *>(b + x);
+    __m128i lo = _mm_cmpeq_epi16(_mm_loadu_si128(p), _mm_loadu_si128(q));
+    __m128i hi =
+        _mm_cmpeq_epi16(_mm_loadu_si128(p + 1), _mm_loadu_si128(q + 1));
+    uint32_t bits = ~_mm_movemask_epi8(_mm_packs_epi16(lo, hi)) & 0xffff;
+    dirty[x / 64] |= uint64_t{bits} << (x % 64);
+  }
+#endif
+  for (; x < n; x++) {
+    if (a[x] != b[x]) dirty[x / 64] |= uint64_t{1} << (x % 64);
+  }
+}
+
+/* Number of the first N cells where A and B differ. */
+static int count(const Cell *a, const Cell *b, int n, uint64_t *dirty) {
+  compare(a, b, n, dirty);
+  int changed = 0;
+  for (int i = 0; i < (n + 63) / 64; i++) {
+    changed += __builtin_popcountll(dirty[i]);
+  }
+  return changed;
+}
+
+void Framebuffer::update(Canvas &screen, std::string &out) {
+  bool fresh = false;
+  if (screen.width != width_ || screen.cells.size() != cells_.size()) {
+    width_ = screen.width;
+    cells_.assign(screen.cells.size(), Cell{' ', 0});
+    out += "\x1b[0m\x1b[2J";
+    attr_ = 0;
+    y_ = x_ = -1;
+    fresh = true;
+  }
+  dirty_.resize((width_ + 63) / 64);
+  const Canvas::Scroll &scroll = screen.scrolled;
+  runs_.clear();
+  for (int y = 0; y < screen.height; y++) {
+    const Cell *cells = &screen.at(y, 0);
+    Canvas::Span span = screen.damage[y];
+    if (fresh || (!stale_.empty() && stale_[y])) {
+      span = Canvas::Span{0, width_};
+    } else if (scroll.count && y >= scroll.top && y < scroll.bottom &&
+               !shift(y, cells, scroll, out)) {
+      span = Canvas::Span{0, width_};
+    }
+    if (span.lo >= span.hi) continue;
+    Cell *row = &cells_[y * width_];
+    compare(cells + span.lo, row + span.lo, span.hi - span.lo, dirty_.data());
+    for (int i = 0; i < (span.hi - span.lo + 63) / 64; i++) {
+      for (uint64_t bits = dirty_[i]; bits; bits &= bits - 1) {
+        int x = span.lo + i * 64 + __builtin_ctzll(bits);
+        uint8_t attr = cells[x].attr & mask_;
+        if (!runs_.empty() && runs_.back().y == y &&
+            runs_.back().x + runs_.back().n == x && runs_.back().attr == attr) {
+          runs_.back().n++;
+        } else {
+          runs_.push_back(Run{y, x, 1, attr});
+        }
+      }
+    }
+  }
+
+  /* Paint the changes grouped by attribute, starting with the current
+   * one, so each attribute is selected about once per frame rather than
+   * wherever it alternates with another.
+   */
+  int current = attr_;
+  std::stable_sort(runs_.begin(), runs_.end(),
+                   [current](const Run &a, const Run &b) {
+                     return (a.attr == current ? -1 : a.attr) <
+                            (b.attr == current ? -1 : b.attr);
+                   });
+  for (const Run &run : runs_) {
+    const Cell *cells = &screen.at(run.y, 0);
+    Cell *row = &cells_[run.y * width_];
+    move(run.y, run.x, out);
+    set(run.attr, out);
+    for (int x = run.x; x < run.x + run.n; x++) {
+      out += cells[x].ch;
+      row[x] = cells[x];
+      sgr_saved += sgr_length(run.attr);
+    }
+    /* Past the last column the cursor's position depends on the
+     * terminal's width and wrap mode.
+     */
+    x_ = run.x + run.n < width_ ? run.x + run.n : -1;
+  }
+  if (screen.cursor) {
+    move(screen.cursor_y, screen.cursor_x, out);
+    if (visible_ != 1) out += "\x1b[?25h";
+  } else if (visible_ != 0) {
+    out += "\x1b[?25l";
+  }
+  visible_ = screen.cursor;
+  stale_.clear();
+  screen.clean();
+}
+
+void Framebuffer::mask(uint8_t attrs) {
+  if (attrs == mask_) return;
+  if (stale_.empty()) stale_.assign(width_ ? cells_.size() / width_ : 0, false);
+  for (size_t i = 0; i < cells_.size(); i++) {
+    Cell &cell = cells_[i];
+    if ((cell.attr & attrs) != (cell.attr & mask_)) {
+      cell.ch = kUnknown;
+      stale_[i / width_] = true;
+    }
+  }
+  mask_ = attrs;
+}
+
+/* Follow the canvas's SCROLL in row Y, if that brings the terminal
+ * closer to ROW, the row's new contents. Deleting characters pulls the
+ * rest of the line left, so as many are inserted at the region's right
+ * edge to push everything beyond it back into place. Returns false if
+ * the row was left alone.
+ */
+bool Framebuffer::shift(int y, const Cell *row, const Canvas::Scroll &scroll,
+                        std::string &out) {
+  Cell *old = &cells_[y * width_];
+  int left = scroll.left, right = std::min(scroll.right, width_);
+  int count = scroll.count, n = right - left;
+  if (count >= n) return false;
+  int plain = ::count(row + left, old + left, n, dirty_.data());
+  if (plain <= kScrollCost) return false;
+  int shifted = ::count(row + left, old + left + count, n - count,
+                        dirty_.data());
+  for (int x = right - count; x < right; x++) {
+    shifted += row[x] != Cell{' ', 0};
+  }
+  if (shifted + kScrollCost >= plain) return false;
+  char buf[32];
+  move(y, left, out);
+  out.append(buf, count == 1 ? sprintf(buf, "\x1b[P")
+                             : sprintf(buf, "\x1b[%dP", count));
+  std::copy(old + left + count, old + right, old + left);
+  move(y, right - count, out);
+  set(0, out);  // the inserted blanks take the current background
+  out.append(buf, count == 1 ? sprintf(buf, "\x1b[@")
+                             : sprintf(buf, "\x1b[%d@", count));
+  std::fill(old + right - count, old + right, Cell{' ', 0});
+  return true;
+}
+
+/* Move the terminal's cursor to (Y, X) in as few bytes as possible. */
+void Framebuffer::move(int y, int x, std::string &out) {
+  if (y == y_ && x == x_) return;
+  char buf[32];
+  if (y == y_ && x_ >= 0 && x > x_) {
+    int gap = x - x_;
+    bool reprint = gap <= kMaxReprint && x <= width_;
+    for (int i = x_; reprint && i < x; i++) {
+      const Cell &cell = cells_[y * width_ + i];
+      reprint = cell.ch != kUnknown && (cell.attr & mask_) == attr_;
+    }
+    if (reprint) {
+      for (int i = x_; i < x; i++) out += cells_[y * width_ + i].ch;
+    } else if (gap == 1) {
+      out += "\x1b[C";
+    } else {
+      out.append(buf, sprintf(buf, "\x1b[%dC", gap));
+    }
+  } else if (x == 0) {
+    out.append(buf, sprintf(buf, "\x1b[%dH", y + 1));
+  } else {
+    out.append(buf, sprintf(buf, "\x1b[%d;%dH", y + 1, x + 1));
+  }
+  y_ = y;
+  x_ = x;
+}
+
+void Framebuffer::set(uint8_t attr, std::string &out) {
+  if (attr != attr_) {
+    int length = sgr(out, attr_, attr);
+    sgr_sent += length > 0;
+    sgr_saved -= length;
+    attr_ = attr;
+  }
+}
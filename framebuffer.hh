@@ -0,0 +1,66 @@
+#ifndef FLAPPY_FRAMEBUFFER_HH
+#define FLAPPY_FRAMEBUFFER_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "display.hh"
+
+/* Remembers what a remote ANSI terminal is showing, so each new frame
+ * is sent as just the cursor movements, SGR changes and characters of
+ * the cells that differ from the last one. Only the canvas's damage is
+ * examined, and its scrolls are repeated on the terminal.
+ */
+class Framebuffer {
+ public:
+  /* Append to OUT the bytes that make the terminal show SCREEN, and
+   * clean SCREEN. The first update, and the first after reset(),
+   * clears the terminal.
+   */
+  void update(Canvas &screen, std::string &out);
+
+  /* Forget the terminal's contents, e.g. after something else wrote
+   * to it.
+   */
+  void reset() { cells_.clear(); }
+
+  /* Show only the attributes in ATTRS. The next update() repaints just
+   * the rows holding cells whose attributes that changes.
+   */
+  void mask(uint8_t attrs);
+
+  /* True if the terminal already shows SCREEN. */
+  bool shows(const Canvas &screen) const {
+    return cells_ == screen.cells && visible_ == screen.cursor;
+  }
+
+  /* SGR sequences sent, and the bytes saved compared to sending a full
+   * one before every cell, since the owner last zeroed them.
+   */
+  uint64_t sgr_sent = 0;
+  int64_t sgr_saved = 0;
+
+ private:
+  /* N changed cells in a row that share an attribute. */
+  struct Run {
+    int y, x, n;
+    uint8_t attr;
+  };
+
+  void move(int y, int x, std::string &out);
+  void set(uint8_t attr, std::string &out);
+  bool shift(int y, const Cell *row, const Canvas::Scroll &scroll,
+             std::string &out);
+
+  std::vector<Cell> cells_;
+  std::vector<bool> stale_;  // per row, holds cells of unknown contents
+  std::vector<uint64_t> dirty_;  // one bit per changed cell in a row
+  std::vector<Run> runs_;
+  int width_ = 0;
+  int y_ = -1, x_ = -1;  // the terminal's cursor, or -1 if unknown
+  int attr_ = -1;
+  int visible_ = -1;
+  uint8_t mask_ = 0xff;
+};
+
+#endif
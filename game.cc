@@ -0,0 +1,185 @@
+#include <atomic>
+#include <cstring>
+#include "game.hh"
+
+bool is_exit(int c) { return c == 'q' || c == ''; }
+
+void print_scores(Display &display, HighScores &scores) {
+  Canvas &screen = display.screen;
+  screen.on(kBold);
+  screen.print(0, display.width + 4, "== High Scores ==");
+  screen.off(kBold);
+  int i = 1;
+  for (auto &line : scores.top_scores()) {
+    screen.print(i, display.width + 1, "%s", line.name.c_str());
+    screen.clear_eol();
+    screen.print(i, display.width + 24, "%d", line.score);
+    i++;
+  }
+}
+
+/* A seed for a new game, different for every call on any thread. */
+static uint64_t new_seed() {
+  static std::atomic<uint64_t> sequence{0};
+  uint64_t x =
+      sequence.fetch_add(0x9e3779b97f4a7c15, std::memory_order_relaxed);
+  x += std::chrono::steady_clock::now().time_since_epoch().count();
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+Session::Session(HighScores *scores, int width, int height)
+    : display{width, height}, scores{scores} {
+  start();
+}
+
+void Session::start() {
+  game.reset(new Game{display.width, display.height, new_seed()});
+  replay.start(*game);
+  title();
+  poked = false;
+  state = kTitle;
+}
+
+void Session::title() {
+  draw_title(display, *game);
+  const Canvas &screen = display.screen;
+  if (cols > 0 && (cols < screen.width || rows < screen.height)) {
+    char message[64];
+    snprintf(message, sizeof(message), "Please enlarge window to %dx%d",
+             screen.width, screen.height);
+    display.center(5, message);
+  }
+}
+
+void Session::window(int cols, int rows) {
+  this->cols = cols;
+  this->rows = rows;
+  if (state == kTitle) title();
+}
+
+void Session::key(int c) {
+  switch (state) {
+    case kTitle:
+      state = is_exit(c) || c == kKeyHangup ? kQuit : kPlay;
+      break;
+    case kPlay:
+      if (is_exit(c) || c == kKeyHangup) {
+        state = kQuit;
+      } else {
+        poked = true;
+      }
+      break;
+    case kName:
+      read_name(c);
+      break;
+    case kRetry:
+      if (c == 'r') {
+        start();
+      } else if (is_exit(c) || c == kKeyHangup) {
+        state = kQuit;
+      }
+      break;
+    case kQuit:
+      break;
+  }
+}
+
+void Session::tick() {
+  if (state != kPlay) return;
+  bool poke = poked;
+  poked = false;
+  stale = true;
+  if (poke) replay.poke(game->world.steps);
+  if (!game->update(poke)) {
+    draw();
+    over();
+  }
+}
+
+/* Bring the canvas up to date with the simulation. */
+void Session::draw() {
+  if (stale) {
+    ::draw(display, *game);
+    stale = false;
+  }
+}
+
+void Session::over() {
+  Canvas &screen = display.screen;
+  draw_crash(display, *game);
+  score = game->score();
+
+  /* Game over */
+  screen.print(display.height + 1, 0, "Game over!");
+  print_scores(display, *scores);
+
+  /* Enter new high score */
+  if (scores->is_best(score)) {
+    screen.on(kBold);
+    screen.print(display.height + 2, 0, "You have a high score!");
+    screen.print(display.height + 3, 0, "Enter name: ");
+    screen.off(kBold);
+    std::memset(name, 0, sizeof(name));
+    name_length = 0;
+    screen.cursor = true;
+    state = kName;
+  } else {
+    prompt_retry();
+  }
+}
+
+void Session::read_name(int c) {
+  Canvas &screen = display.screen;
+  int y = display.height + 3, x = 12;
+  uint8_t style = kBold | kUnderline | pair(4);
+  switch (c) {
+    case '':
+      state = kQuit;
+      return;
+    case '\n':
+    case '\r':
+    case kKeyHangup:
+      submit_name();
+      return;
+    case '\b':
+    case kKeyBackspace:
+      if (name_length > 0) {
+        name[--name_length] = '\0';
+        screen.put(y, x + name_length, ' ');
+      }
+      break;
+    case ' ':
+      if (name_length == 0) {
+        break;
+      }
+    default:
+      if (c >= ' ' && c < 0x7f && name_length < (int)sizeof(name) - 1) {
+        name[name_length] = c;
+        screen.on(style);
+        screen.put(y, x + name_length++, c);
+        screen.off(style);
+      }
+  }
+  screen.seek(y, x + name_length);
+}
+
+void Session::submit_name() {
+  Canvas &screen = display.screen;
+  if (name_length == 0) {
+    std::strcpy(name, "(anonymous)");
+  }
+  scores->submit_score(name, score, replay.bytes());
+  screen.seek(display.height + 3, 0);
+  screen.clear_eol();
+  screen.cursor = false;
+  print_scores(display, *scores);
+  prompt_retry();
+}
+
+void Session::prompt_retry() {
+  display.screen.print(display.height + 2, 0,
+                       "Press 'q' to quit, 'r' to retry.");
+  state = kRetry;
+}
@@ -0,0 +1,80 @@
+/* game.hh --- flappy bird per-player session flow
+ * This is free and unencumbered software released into the public domain.
+ */
+#ifndef FLAPPY_GAME_HH
+#define FLAPPY_GAME_HH
+
+#include <chrono>
+#include <memory>
+#include "display.hh"
+#include "highscores.hh"
+#include "replay.hh"
+#include "sim.hh"
+
+/* Default time between simulation ticks, and between rendered frames,
+ * while playing.
+ */
+constexpr std::chrono::milliseconds kFramePeriod{67};
+
+/* Most simulation ticks run to catch up before one rendered frame,
+ * beyond the ones a frame period holds anyway.
+ */
+constexpr int kMaxTicksPerFrame = 4;
+
+/* How often the simulation ticks and the screen is drawn. Physics are
+ * defined per tick, so only the tick period changes the game's speed.
+ */
+struct Rates {
+  std::chrono::nanoseconds tick{kFramePeriod}, frame{kFramePeriod};
+
+  /* Most ticks to run before one frame: the ticks due in a frame
+   * period, plus kMaxTicksPerFrame to catch up with.
+   */
+  int max_ticks() const {
+    return (frame.count() + tick.count() - 1) / tick.count() +
+           kMaxTicksPerFrame;
+  }
+};
+
+/* Keys understood by Session::key() beyond plain ASCII. */
+enum { kKeyHangup = -1, kKeyBackspace = 0x7f };
+
+bool is_exit(int c);
+
+void print_scores(Display &display, HighScores &scores);
+
+/* One player's trip through the title screen, play, high score entry
+ * and retry prompt. The session never blocks: the host feeds it keys
+ * and, while playing, calls tick() at the simulation rate and draw()
+ * whenever it wants a frame.
+ */
+struct Session {
+  enum State { kTitle, kPlay, kName, kRetry, kQuit };
+
+  Session(HighScores *scores, int width = kWidth, int height = kHeight);
+
+  Display display;
+  HighScores *scores;
+  std::unique_ptr<Game> game;
+  Replay replay;  // the inputs to the current or last game
+  State state = kTitle;
+  bool poked = false, stale = false;
+  int score = 0, name_length = 0;
+  char name[23];
+  int cols = 0, rows = 0;  // client window size, when known
+
+  void key(int c);
+  void tick();
+  void draw();
+  void window(int cols, int rows);
+
+ private:
+  void start();
+  void title();
+  void over();
+  void read_name(int c);
+  void submit_name();
+  void prompt_retry();
+};
+
+#endif
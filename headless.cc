@@ -0,0 +1,200 @@
+/* headless.cc --- flappy bird simulation without a terminal
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Plays games with the autopilot as fast as the CPU allows and reports
+ * the simulation rate, optionally drawing every tick through one of the
+ * renderers.
+ */
+
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include "batch.hh"
+#include "display.hh"
+#include "pacing.hh"
+#include "renderer.hh"
+#include "replay.hh"
+#include "sim.hh"
+#include "verify.hh"
+
+/* Totals over a run of games. */
+struct Run {
+  uint64_t ticks = 0, total = 0, replay_bytes = 0;
+  int best = 0;
+};
+
+/* The autopilot's choice for GAME's next tick, recorded in REPLAY. */
+static bool steer(const Game &game, Replay &replay) {
+  bool poke = autopilot(game);
+  if (poke) replay.poke(game.world.steps);
+  return poke;
+}
+
+/* Play GAMES games of at most LIMIT ticks, seeded SEED, SEED + 1 and
+ * so on, drawing each tick through RENDERER unless it is null. Every
+ * game is recorded, and its score claimed to VERIFIER unless null.
+ */
+template <typename Renderer>
+static Run play(Renderer *renderer, long games, long limit, uint64_t seed,
+                Verifier *verifier) {
+  Run run;
+  Display display;
+  Replay replay;
+  for (long i = 0; i < games; i++) {
+    Game game{kWidth, kHeight, seed + i};
+    replay.start(game);
+    if (renderer) display.erase();
+    for (long t = 0; t < limit && game.update(steer(game, replay)); t++) {
+      if (renderer) {
+        draw(display, game);
+        renderer->present(display.screen);
+      }
+    }
+    run.ticks += game.world.steps;
+    run.total += game.score();
+    run.best = std::max(run.best, game.score());
+    run.replay_bytes += replay.bytes().size();
+    if (verifier) verifier->submit(Claim{"", game.score(), replay.bytes()});
+  }
+  return run;
+}
+
+/* Play GAMES games of at most LIMIT ticks as play() does, but on the
+ * batch simulator, LANES at a time. Whenever a lane's game is over, the
+ * next game starts in it, so the lanes stay busy until the last games.
+ */
+static Run play_batch(long games, long limit, uint64_t seed, int lanes) {
+  Run run;
+  Batch batch{(int)std::min<long>(lanes, games), seed};
+  std::vector<uint64_t> pokes(batch.words());
+  std::vector<bool> idle(batch.lanes());
+  long started = batch.lanes(), finished = 0;
+  while (finished < games) {
+    for (int i = 0; batch.can_restart() && i < batch.lanes(); i++) {
+      if (idle[i] || (batch.alive(i) && batch.steps(i) < limit)) continue;
+      long steps = std::min<long>(batch.steps(i), limit);
+      run.ticks += steps;
+      run.total += World::score(steps);
+      run.best = std::max(run.best, World::score(steps));
+      finished++;
+      if (started < games) {
+        batch.restart(i, seed + started++);
+      } else {
+        idle[i] = true;
+      }
+    }
+    batch.autopilot(pokes.data());
+    batch.update(pokes.data());
+  }
+  return run;
+}
+
+int main(int argc, char **argv) {
+  /* Parse command line arguments. */
+  int opt;
+  long games = 10000, limit = 100000;
+  uint64_t seed = std::time(NULL);
+  bool check = false;
+  int lanes = 0;
+  int threads = std::thread::hardware_concurrency();
+  const char *render = nullptr;
+  while ((opt = getopt(argc, argv, "b:j:m:n:pr:s:")) != -1) {
+    switch (opt) {
+      case 'b':
+        lanes = std::max(1, atoi(optarg));
+        break;
+      case 'j':
+        threads = std::max(0, atoi(optarg));
+        break;
+      case 'm':
+        limit = atol(optarg);
+        break;
+      case 'n':
+        games = atol(optarg);
+        break;
+      case 'p':
+        check = true;
+        break;
+      case 's':
+        seed = strtoull(optarg, nullptr, 10);
+        break;
+      case 'r':
+        render = optarg;
+        if (!std::strcmp(render, "null") || !std::strcmp(render, "ansi")) {
+          break;
+        }
+      default:
+        fprintf(stderr,
+                "usage: %s [-n games] [-m max-ticks] [-b lanes | -p] "
+                "[-j threads] [-r null|ansi] [-s seed]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (lanes && (render || check)) {
+    fprintf(stderr, "%s: -b can't be combined with -p or -r\n", argv[0]);
+    return 1;
+  }
+
+  Run run;
+  uint64_t bytes = 0, sgr_sent = 0;
+  int64_t sgr_saved = 0;
+  std::unique_ptr<Verifier> verifier;
+  if (check) verifier.reset(new Verifier{threads, [](const Claim &) {}});
+  uint64_t start = monotonic_ns();
+  if (lanes) {
+    run = play_batch(games, limit, seed, lanes);
+  } else if (!render) {
+    run = play<NullRenderer>(nullptr, games, limit, seed, verifier.get());
+  } else if (!std::strcmp(render, "null")) {
+    NullRenderer renderer;
+    run = play(&renderer, games, limit, seed, verifier.get());
+  } else {
+    AnsiRenderer renderer{open("/dev/null", O_WRONLY)};
+    run = play(&renderer, games, limit, seed, verifier.get());
+    bytes = renderer.bytes;
+    sgr_sent = renderer.sgr_sent();
+    sgr_saved = renderer.sgr_saved();
+  }
+  double seconds = (monotonic_ns() - start) / 1e9;
+
+  printf("%ld games, %llu ticks in %.3fs: %.1fM ticks/s, %.0f games/s\n",
+         games, (unsigned long long)run.ticks, seconds,
+         run.ticks / seconds / 1e6, games / seconds);
+  printf("mean score %.2f, best %d, seed %llu\n",
+         games ? (double)run.total / games : 0.0, run.best,
+         (unsigned long long)seed);
+  if (lanes) {
+    printf("batches of %d lanes, %s\n", lanes,
+#ifdef __AVX2__
+           "AVX2"
+#else
+           "scalar"
+#endif
+    );
+  } else {
+    printf("replays: %.1f bytes per game\n",
+           games ? (double)run.replay_bytes / games : 0.0);
+  }
+  if (verifier) {
+    verifier->drain();
+    printf("verifier on %d threads: ", threads);
+    verifier->report(stdout, (monotonic_ns() - start) / 1e9);
+    printf("\n");
+  }
+  if (render) {
+    printf("%s renderer: %.0fns per frame", render, seconds * 1e9 / run.ticks);
+    if (bytes) {
+      printf(", %.0f bytes and %.1f SGR sequences per frame, saving %.0f",
+             (double)bytes / run.ticks, (double)sgr_sent / run.ticks,
+             (double)sgr_saved / run.ticks);
+    }
+    printf("\n");
+  }
+  return 0;
+}
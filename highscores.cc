@@ -13,8 +13,11 @@ static const char *insert = "INSERT INTO scores VALUES (?, ?)";
 #define REGISTER(name) \
   sqlite3_prepare_v2(db, name, std::strlen(name), &stmt_##name, nullptr);
 
-HighScores::HighScores(const char *file, int size) {
+HighScores::HighScores(const char *file, int size, int verifiers) {
   size_ = size;
+  verifier_.reset(new Verifier{verifiers, [this](const Claim &claim) {
+                                 insert_score(claim.name.c_str(), claim.score);
+                               }});
   sqlite3_initialize();
   int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
   sqlite3_open_v2(file, &db, flags, nullptr);
@@ -34,11 +37,13 @@ HighScores::HighScores(const char *file, int size) {
 }
 
 HighScores::~HighScores() {
+  verifier_.reset();  // its threads may still be inserting
   sqlite3_close(db);
   sqlite3_shutdown();
 }
 
 bool HighScores::is_best(int score) {
+  std::lock_guard<std::mutex> lock{lock_};
   sqlite3_bind_int(stmt_place, 1, score);
   sqlite3_step(stmt_place);
   int count = sqlite3_column_int(stmt_place, 0);
@@ -47,13 +52,20 @@ bool HighScores::is_best(int score) {
 }
 
 void HighScores::insert_score(const char *name, int score) {
+  std::lock_guard<std::mutex> lock{lock_};
   sqlite3_bind_text(stmt_insert, 1, name, -1, SQLITE_TRANSIENT);
   sqlite3_bind_int(stmt_insert, 2, score);
   sqlite3_step(stmt_insert);
   sqlite3_reset(stmt_insert);
 }
 
+void HighScores::submit_score(const char *name, int score,
+                              const std::vector<uint8_t> &replay) {
+  verifier_->submit(Claim{name, score, replay});
+}
+
 std::vector<listing> HighScores::top_scores() {
+  std::lock_guard<std::mutex> lock{lock_};
   std::vector<listing> scores;
   sqlite3_bind_int(stmt_top, 1, size_);
   while (sqlite3_step(stmt_top) == SQLITE_ROW) {
@@ -1,26 +1,39 @@
 #ifndef FLAPPY_HIGHSCORES_HH
 #define FLAPPY_HIGHSCORES_HH
 
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include "sqlite3.h"
+#include "verify.hh"
 
 struct listing {
   std::string name;
   int score;
 };
 
+/* The best SIZE scores, kept in an SQLite database. Scores submitted
+ * with a replay are only inserted once VERIFIERS threads (or, with
+ * none, the submitting thread) have played the replay to that score.
+ */
 class HighScores {
  public:
-  HighScores(const char *file, int size = 10);
+  HighScores(const char *file, int size = 10, int verifiers = 0);
   ~HighScores();
 
   bool is_best(int score);
   void insert_score(const char *name, int score);
+  void submit_score(const char *name, int score,
+                    const std::vector<uint8_t> &replay);
   std::vector<listing> top_scores();
 
+  Verifier &verifier() { return *verifier_; }
+
  private:
   int size_;
+  std::unique_ptr<Verifier> verifier_;
+  std::mutex lock_;  // sessions on several threads share one connection
   sqlite3 *db;
   sqlite3_stmt *stmt_table, *stmt_timeout, *stmt_top, *stmt_place, *stmt_insert;
 };
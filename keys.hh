@@ -0,0 +1,40 @@
+#ifndef FLAPPY_KEYS_HH
+#define FLAPPY_KEYS_HH
+
+#include "game.hh"
+
+/* Returned when there is no key (yet). */
+static const int kNoKey = -2;
+
+/* Translates raw terminal input into Session keys, swallowing escape
+ * sequences and the NUL or LF that telnet sends after a CR.
+ */
+struct KeyDecoder {
+  enum { kNormal, kEscape, kSequence } state = kNormal;
+  bool cr = false;
+
+  int decode(unsigned char c) {
+    bool after_cr = cr;
+    cr = c == '\r';
+    switch (state) {
+      case kNormal:
+        if (c == 0x1b) {
+          state = kEscape;
+          return kNoKey;
+        } else if (after_cr && (c == '\0' || c == '\n')) {
+          return kNoKey;
+        }
+        return c == '\b' ? kKeyBackspace : c;
+      case kEscape:
+        state = c == '[' || c == 'O' ? kSequence : kNormal;
+        return kNoKey;
+      case kSequence:
+        if (c < 0x40 || c > 0x7e) return kNoKey;
+        state = kNormal;
+        return c == 'D' ? kKeyBackspace : kNoKey;
+    }
+    return kNoKey;
+  }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include <cerrno>
+#include <cstring>
+#include <zlib.h>
+#include "output.hh"
+
+struct Output::Deflater {
+  z_stream stream;
+  int flush;
+};
+
+Output::Output() : segments_(1) {}
+
+Output::~Output() {
+  if (deflater_) deflateEnd(&deflater_->stream);
+}
+
+bool Output::compress(Flush flush) {
+  static const int kFlushes[] = {Z_PARTIAL_FLUSH, Z_SYNC_FLUSH, Z_FULL_FLUSH};
+  std::unique_ptr<Deflater> deflater{new Deflater};
+  std::memset(&deflater->stream, 0, sizeof(deflater->stream));
+  deflater->flush = kFlushes[flush];
+  if (deflateInit(&deflater->stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    return false;
+  }
+  deflater_ = std::move(deflater);
+  return true;
+}
+
+void Output::uncompress() {
+  if (!deflater_) return;
+  deflate_plain(Z_FINISH);
+  deflateEnd(&deflater_->stream);
+  deflater_.reset();
+}
+
+size_t Output::pending() const {
+  size_t size = plain_.size();
+  for (const Segment &segment : segments_) size += segment.size();
+  return size - sent_;
+}
+
+bool Output::write(int fd) {
+  seal();
+  while (pending()) {
+    msghdr message;
+    int flags = gather(message);
+    calls++;
+    ssize_t n = sendmsg(fd, &message, flags);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0) {
+      return errno == EAGAIN;
+    }
+    consume(n);
+  }
+  return true;
+}
+
+int Output::gather(msghdr &message) {
+  seal();
+  int count = 0;
+  size_t skip = sent_;
+  bool more = false;
+  auto add = [&](const std::string &bytes) {
+    if (skip >= bytes.size()) {
+      skip -= bytes.size();
+    } else if (count < kMaxIovecs) {
+      iov_[count].iov_base = const_cast<char *>(bytes.data() + skip);
+      iov_[count].iov_len = bytes.size() - skip;
+      count++;
+      skip = 0;
+    } else {
+      more = true;
+    }
+  };
+  for (const Segment &segment : segments_) {
+    if (segment.shared) add(*segment.shared);
+    add(segment.own);
+  }
+  std::memset(&message, 0, sizeof(message));
+  message.msg_iov = iov_;
+  message.msg_iovlen = count;
+  /* If the queue doesn't fit in one call, hold back the partial
+   * packet until the rest follows, as TCP_CORK would.
+   */
+  return MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+}
+
+void Output::consume(size_t n) {
+  written += n;
+  sent_ += n;
+  while (segments_.size() > 1 && sent_ >= segments_.front().size()) {
+    sent_ -= segments_.front().size();
+    segments_.pop_front();
+  }
+  if (sent_ && sent_ == segments_.front().size()) {
+    segments_.front().shared.reset();
+    segments_.front().own.clear();
+    sent_ = 0;
+  }
+}
+
+/* Deflate the bytes appended since the last write onto the queue. */
+void Output::seal() {
+  if (deflater_ && !plain_.empty()) deflate_plain(deflater_->flush);
+}
+
+/* Deflate plain_ onto the queue, ending with zlib's FLUSH. */
+void Output::deflate_plain(int flush) {
+  z_stream &stream = deflater_->stream;
+  std::string &out = segments_.back().own;
+  stream.next_in = reinterpret_cast<Bytef *>(&plain_[0]);
+  stream.avail_in = plain_.size();
+  do {
+    size_t size = out.size();
+    out.resize(size + plain_.size() / 2 + 64);
+    stream.next_out = reinterpret_cast<Bytef *>(&out[size]);
+    stream.avail_out = out.size() - size;
+    deflate(&stream, flush);
+    out.resize(out.size() - stream.avail_out);
+  } while (stream.avail_out == 0);
+  plain_.clear();
+}
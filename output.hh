@@ -0,0 +1,96 @@
+#ifndef FLAPPY_OUTPUT_HH
+#define FLAPPY_OUTPUT_HH
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+
+/* Bytes that never change once built, shared by any number of Outputs. */
+typedef std::shared_ptr<const std::string> Shared;
+
+/* Bytes queued for a socket. Most are appended to the tail by the owner,
+ * but shared buffers are queued by reference and written straight from
+ * their own memory, everything pending in a single sendmsg(). Once
+ * compressing, everything is deflated instead, as one zlib stream.
+ */
+class Output {
+ public:
+  /* How the compressed stream is flushed at each write, so the client
+   * can decode all of it: PARTIAL costs the fewest bytes, SYNC ends on
+   * a byte boundary, and FULL also forgets the history, at a cost in
+   * compression.
+   */
+  enum Flush { kPartial, kSync, kFull };
+
+  Output();
+  ~Output();
+
+  /* Where to append bytes of one's own. */
+  std::string &tail() { return deflater_ ? plain_ : segments_.back().own; }
+
+  /* Queue BYTES, after everything appended so far. */
+  void share(Shared bytes) {
+    if (deflater_) {
+      plain_ += *bytes;
+    } else {
+      segments_.push_back(Segment{std::move(bytes), std::string{}});
+    }
+  }
+
+  /* Deflate everything queued from now on, flushing as FLUSH says.
+   * Returns false if zlib can't.
+   */
+  bool compress(Flush flush);
+
+  /* End the compressed stream after everything queued so far, and
+   * queue whatever follows as it is.
+   */
+  void uncompress();
+
+  /* Bytes not written yet, counting those still to be compressed. */
+  size_t pending() const;
+
+  /* Write as much as socket FD accepts without blocking. Returns false
+   * on any error but EAGAIN.
+   */
+  bool write(int fd);
+
+  /* Point MESSAGE at as many pending bytes as one sendmsg() can take,
+   * and return the flags to send them with. MESSAGE is good until the
+   * queue next changes.
+   */
+  int gather(msghdr &message);
+
+  /* Drop N written bytes from the front of the queue. */
+  void consume(size_t n);
+
+  /* sendmsg() calls made by write(), and bytes written. */
+  uint64_t calls = 0, written = 0;
+
+ private:
+  struct Deflater;
+
+  /* Most iovecs handed to one sendmsg(). */
+  static const int kMaxIovecs = 16;
+
+  /* A shared buffer, if any, followed by one's own bytes. */
+  struct Segment {
+    Shared shared;
+    std::string own;
+
+    size_t size() const { return (shared ? shared->size() : 0) + own.size(); }
+  };
+
+  void seal();
+  void deflate_plain(int flush);
+
+  std::deque<Segment> segments_;
+  size_t sent_ = 0;  // bytes of the front segment already written
+  iovec iov_[kMaxIovecs];
+  std::unique_ptr<Deflater> deflater_;
+  std::string plain_;  // appended since the last write, to be deflated
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef FLAPPY_PACING_HH
+#define FLAPPY_PACING_HH
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <time.h>
+
+inline uint64_t monotonic_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+inline timespec to_timespec(uint64_t ns) {
+  timespec ts;
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  return ts;
+}
+
+/* How late deadlines were met, in power-of-two millisecond buckets:
+ * on time (under 1ms), then under 2ms, 4ms, ... and everything past
+ * the last bucket. Safe to read from another thread while recording.
+ */
+struct Histogram {
+  static constexpr int kBuckets = 12;
+
+  std::atomic<uint64_t> buckets[kBuckets];
+
+  Histogram() { clear(); }
+
+  void add(uint64_t late_ns) {
+    int i = 0;
+    for (uint64_t ms = late_ns / 1000000; ms && i < kBuckets - 1; ms >>= 1) i++;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void clear() {
+    for (auto &bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+  }
+
+  /* Print a one-line summary of missed deadlines, then clear. */
+  void report(FILE *out) {
+    uint64_t counts[kBuckets], total = 0;
+    for (int i = 0; i < kBuckets; i++) {
+      counts[i] = buckets[i].exchange(0, std::memory_order_relaxed);
+      total += counts[i];
+    }
+    fprintf(out, "missed %llu of %llu deadlines",
+            (unsigned long long)(total - counts[0]), (unsigned long long)total);
+    for (int i = 1; i < kBuckets; i++) {
+      if (counts[i]) {
+        fprintf(out, ", %s%dms %llu", i == kBuckets - 1 ? ">" : "<",
+                1 << (i == kBuckets - 1 ? i - 1 : i),
+                (unsigned long long)counts[i]);
+      }
+    }
+  }
+};
+
+/* Paces a loop against absolute CLOCK_MONOTONIC deadlines, so the time
+ * spent inside the loop doesn't add to its period. A loop that falls
+ * more than a few periods behind is resynchronized rather than allowed
+ * to race through the backlog.
+ */
+class Pacer {
+ public:
+  static constexpr int kMaxLag = 4;  // periods
+
+  explicit Pacer(std::chrono::nanoseconds period)
+      : period_(period.count()) {
+    start();
+  }
+
+  void start() { next_ = monotonic_ns(); }
+
+  /* True if the upcoming deadline has already passed. */
+  bool behind() const { return monotonic_ns() > next_ + period_; }
+
+  /* Sleep until the next deadline. */
+  void wait() {
+    next_ += period_;
+    uint64_t now = monotonic_ns();
+    if (now > next_ + kMaxLag * period_) {
+      lateness.add(now - next_);
+      resyncs++;
+      next_ = now;
+      return;
+    }
+    timespec ts = to_timespec(next_);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) ==
+           EINTR)
+      ;
+    now = monotonic_ns();
+    lateness.add(now - next_);
+  }
+
+  Histogram lateness;
+  uint64_t resyncs = 0;
+
+ private:
+  uint64_t period_, next_;
+};
+
+#endif
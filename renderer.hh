@@ -0,0 +1,50 @@
+#ifndef FLAPPY_RENDERER_HH
+#define FLAPPY_RENDERER_HH
+
+#include <string>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include "display.hh"
+#include "framebuffer.hh"
+
+/* Renderers show a Canvas somewhere. The code driving them is templated
+ * on the renderer, so present() is resolved at compile time. Besides
+ * these, flappy.cc has one that draws through ncurses.
+ */
+
+/* Throws frames away, for measuring everything up to the output. */
+struct NullRenderer {
+  void present(Canvas &screen) { screen.clean(); }
+};
+
+/* Writes frames to a file descriptor as raw ANSI escape sequences,
+ * assuming nothing else writes there.
+ */
+class AnsiRenderer {
+ public:
+  explicit AnsiRenderer(int fd) : fd_{fd} {}
+
+  void present(Canvas &screen) {
+    framebuffer_.update(screen, out_);
+    bytes += out_.size();
+    for (size_t sent = 0; sent < out_.size();) {
+      ssize_t n = write(fd_, out_.data() + sent, out_.size() - sent);
+      if (n < 0 && errno != EINTR) break;
+      if (n > 0) sent += n;
+    }
+    out_.clear();
+  }
+
+  uint64_t sgr_sent() const { return framebuffer_.sgr_sent; }
+  int64_t sgr_saved() const { return framebuffer_.sgr_saved; }
+
+  uint64_t bytes = 0;  // written so far
+
+ private:
+  int fd_;
+  Framebuffer framebuffer_;
+  std::string out_;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "replay.hh"
+
+/* Largest board a replay may ask for. Wall heights are kept in bytes. */
+static const uint64_t kMaxWidth = 4096, kMaxHeight = 255;
+
+ReplayReader::ReplayReader(const uint8_t *data, size_t size)
+    : p_{data}, end_{data + size} {
+  uint64_t width, height;
+  if (!get(&width) || !get(&height) || !get(&seed_) || width < 3 ||
+      width > kMaxWidth || height < 1 || height > kMaxHeight) {
+    valid_ = false;
+    width = height = 3;
+  }
+  width_ = width;
+  height_ = height;
+  read_poke(0);
+}
+
+/* Decode the next varint into X. */
+bool ReplayReader::get(uint64_t *x) {
+  *x = 0;
+  for (int shift = 0; p_ < end_ && shift < 64; shift += 7) {
+    uint8_t byte = *p_++;
+    *x |= uint64_t{byte & 0x7fu} << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+/* Move on to the next poke, which is at tick FROM or later. */
+void ReplayReader::read_poke(uint64_t from) {
+  uint64_t gap;
+  if (!valid_ || p_ == end_) {
+    poke_ = kNever;
+  } else if (!get(&gap) || gap >= kNever - from) {
+    valid_ = false;
+    poke_ = kNever;
+  } else {
+    poke_ = from + gap;
+  }
+}
+
+int replay(const uint8_t *data, size_t size, uint64_t limit) {
+  ReplayReader reader{data, size};
+  if (!reader.valid()) return -1;
+  Game game = reader.game();
+  for (uint64_t t = 0; t < limit; t++) {
+    if (!game.update(reader.poke(game.world.steps))) break;
+  }
+  return reader.valid() && reader.done() ? game.score() : -1;
+}
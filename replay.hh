@@ -0,0 +1,98 @@
+/* replay.hh --- compact records of the inputs to a game
+ * This is free and unencumbered software released into the public domain.
+ */
+#ifndef FLAPPY_REPLAY_HH
+#define FLAPPY_REPLAY_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "sim.hh"
+
+/* Everything needed to play a game again: its board width and height
+ * and its seed, then for each poke the ticks between it and the one
+ * before (or the start), all as LEB128 varints. The game goes on until
+ * the bird dies, so nothing follows the last poke. A typical game fits
+ * in a few dozen bytes.
+ */
+class Replay {
+ public:
+  /* Bytes reserved up front, and kept from game to game, so that
+   * recording all but the longest games never allocates.
+   */
+  static constexpr size_t kReserve = 1024;
+
+  Replay() { bytes_.reserve(kReserve); }
+
+  /* Begin recording GAME, which has not been ticked yet. */
+  void start(const Game &game) {
+    bytes_.clear();
+    put(game.world.width);
+    put(game.world.height);
+    put(game.world.seed);
+    next_ = 0;
+  }
+
+  /* Note that the game is poked on its next tick, TICK being the
+   * current World::steps.
+   */
+  void poke(uint64_t tick) {
+    put(tick - next_);
+    next_ = tick + 1;
+  }
+
+  const std::vector<uint8_t> &bytes() const { return bytes_; }
+
+ private:
+  void put(uint64_t x) {
+    for (; x >= 0x80; x >>= 7) bytes_.push_back(x | 0x80);
+    bytes_.push_back(x);
+  }
+
+  std::vector<uint8_t> bytes_;
+  uint64_t next_ = 0;  // the tick a poke with no gap would fall on
+};
+
+/* Feeds a recorded game's inputs back, one tick at a time. */
+class ReplayReader {
+ public:
+  ReplayReader(const uint8_t *data, size_t size);
+
+  /* A fresh game on the recorded board with the recorded seed. */
+  Game game() const { return Game{width_, height_, seed_}; }
+
+  /* Whether the game is poked on tick TICK, the current World::steps.
+   * Ticks must be asked about in order.
+   */
+  bool poke(uint64_t tick) {
+    if (tick != poke_) return false;
+    read_poke(tick + 1);
+    return true;
+  }
+
+  /* False if the replay is malformed. */
+  bool valid() const { return valid_; }
+
+  /* True once every recorded poke has been fed back. */
+  bool done() const { return p_ == end_ && poke_ == kNever; }
+
+ private:
+  static constexpr uint64_t kNever = UINT64_MAX;
+
+  bool get(uint64_t *x);
+  void read_poke(uint64_t from);
+
+  const uint8_t *p_, *end_;
+  bool valid_ = true;
+  int width_ = 0, height_ = 0;
+  uint64_t seed_ = 0;
+  uint64_t poke_ = kNever;  // the tick of the next poke
+};
+
+/* Play the game recorded in DATA again until the bird dies or LIMIT
+ * ticks pass, and return its score. Returns -1 if the replay is
+ * malformed, or pokes a bird that has already died.
+ */
+int replay(const uint8_t *data, size_t size, uint64_t limit = UINT64_MAX);
+
+#endif
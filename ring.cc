@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "ring.hh"
+
+Ring::~Ring() {
+  if (sqes_) munmap(sqes_, sqes_size_);
+  if (cq_ && cq_ != sq_) munmap(cq_, cq_size_);
+  if (sq_) munmap(sq_, sq_size_);
+  if (fd_ >= 0) close(fd_);
+}
+
+bool Ring::setup(unsigned entries) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  fd_ = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd_ < 0) return false;
+
+  /* Map the submission ring, the completion ring (usually in the same
+   * mapping) and the request array.
+   */
+  sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+  sq_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ == MAP_FAILED) {
+    sq_ = nullptr;
+    return false;
+  }
+  cq_ = single ? sq_
+               : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+  if (cq_ == MAP_FAILED) {
+    cq_ = nullptr;
+    return false;
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) return false;
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(sq_), *cq = static_cast<char *>(cq_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  entries_ = params.sq_entries;
+  tail_ = *sq_tail_;
+  return true;
+}
+
+bool Ring::supports(unsigned opcode) const {
+  size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  std::unique_ptr<char[]> buffer{new char[size]()};
+  io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(buffer.get());
+  if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe,
+              256) < 0) {
+    return false;
+  }
+  return opcode < probe->ops_len &&
+         probe->ops[opcode].flags & IO_URING_OP_SUPPORTED;
+}
+
+io_uring_sqe *Ring::prepare() {
+  if (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= entries_) {
+    return nullptr;
+  }
+  unsigned index = tail_ & *sq_mask_;
+  io_uring_sqe *sqe = &sqes_[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  tail_++;
+  queued_++;
+  return sqe;
+}
+
+bool Ring::submit() {
+  unsigned count = queued_;
+  __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+  queued_ = 0;
+  pending_ += count;
+  while (count || ready() < pending_) {
+    calls++;
+    long n = syscall(__NR_io_uring_enter, fd_, count, pending_,
+                     IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (n < 0 && errno != EINTR) return false;
+    if (n > 0) count -= std::min<unsigned>(count, n);
+  }
+  return true;
+}
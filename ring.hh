@@ -0,0 +1,73 @@
+#ifndef FLAPPY_RING_HH
+#define FLAPPY_RING_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+/* A bare io_uring, driven with raw system calls so no library is
+ * needed. Requests are queued with prepare() and handed to the kernel
+ * all at once by submit(). Where the kernel lacks io_uring, or a
+ * sandbox forbids it, setup() fails and callers stick to ordinary
+ * system calls.
+ */
+class Ring {
+ public:
+  Ring() = default;
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+  ~Ring();
+
+  /* Create a ring with room for ENTRIES queued requests. */
+  bool setup(unsigned entries);
+
+  /* True if the kernel handles requests of type OPCODE. Kernels too old
+   * to be asked (before 5.6) are taken to support none.
+   */
+  bool supports(unsigned opcode) const;
+
+  /* A zeroed request to fill in, or null if the queue is full. */
+  io_uring_sqe *prepare();
+
+  /* Requests prepared but not yet submitted. */
+  unsigned queued() const { return queued_; }
+
+  /* Submit the queued requests, and wait until everything submitted
+   * so far has completed: the requests meant for this ring never block,
+   * so that takes one system call. Returns false on failure.
+   */
+  bool submit();
+
+  /* Call F on each completion, oldest first. F may prepare, submit
+   * and reap further requests itself.
+   */
+  template <typename F>
+  void reap(F f) {
+    while (ready()) {
+      unsigned head = *cq_head_;
+      io_uring_cqe cqe = cqes_[head & *cq_mask_];
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      pending_--;
+      f(cqe);
+    }
+  }
+
+  /* io_uring_enter() calls so far. */
+  uint64_t calls = 0;
+
+ private:
+  unsigned ready() const {
+    return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+  }
+
+  int fd_ = -1;
+  void *sq_ = nullptr, *cq_ = nullptr;
+  size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+  unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+  unsigned *cq_head_, *cq_tail_, *cq_mask_;
+  io_uring_sqe *sqes_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+  unsigned entries_ = 0, tail_ = 0, queued_ = 0, pending_ = 0;
+};
+
+#endif
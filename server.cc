@@ -0,0 +1,828 @@
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include "framebuffer.hh"
+#include "game.hh"
+#include "keys.hh"
+#include "output.hh"
+#include "server.hh"
+#include "telnet.hh"
+#include "pacing.hh"
+#include "ring.hh"
+#include "timer.hh"
+
+/* Drop a client whose output backs up beyond this many bytes. */
+static const size_t kMaxBacklog = 1 << 20;
+
+/* Let the kernel hold at most about one full frame of unsent output
+ * per client, so frames aren't queued up behind a slow link.
+ */
+static const int kUnsentLimit = 4 << 10;
+
+/* Socket events handled per epoll_wait(), and bytes read per event. */
+static const int kMaxEvents = 64;
+static const int kReadSize = 4096;
+
+/* Requests queued on a worker's io_uring before it must submit them. */
+static const unsigned kRingEntries = 256;
+
+/* Steal once a shard has this many more sessions than the thief. */
+static const int kImbalance = 4;
+
+/* Timer periods, in milliseconds (the timing wheel's tick). */
+static const uint64_t kBalancePeriod = 100;
+static const uint64_t kNameTimeout = 60 * 1000;
+static const uint64_t kIdleTimeout = 5 * 60 * 1000;
+
+/* A session this many frames behind skips ahead instead of catching up. */
+static const uint64_t kMaxLag = 4;
+
+/* What a client is sent at each quality level: the attributes shown,
+ * and one frame of how many drawn. Lower levels are for connections
+ * that can't keep up; the simulation runs at full rate regardless.
+ */
+struct Quality {
+  uint8_t attrs;
+  int stride;
+};
+static const Quality kQualities[] = {
+    {0xff, 1}, {0, 1}, {0, 2}, {0, 3},
+};
+static const int kLowest = sizeof(kQualities) / sizeof(kQualities[0]) - 1;
+
+/* A playing client's connection is checked this often, in milliseconds.
+ * Its quality drops a level whenever frames are dropped, output is
+ * queued or the round trip exceeds the shortest one seen on the
+ * connection by more than kMaxQueueing microseconds, which means
+ * packets are waiting in some queue along the way. It rises again
+ * after kCalmChecks checks in a row with none of that. A distant but
+ * uncongested client keeps a steady round trip, so it keeps full
+ * quality.
+ */
+static const uint64_t kAdaptPeriod = 1000;
+static const uint32_t kMaxQueueing = 100 * 1000;
+static const int kCalmChecks = 5;
+
+/* A connected player. Its timer fires for the session's next frame or
+ * for whichever timeout applies to the state it is waiting in.
+ */
+struct Server::Client : Timer {
+  Client(int fd, HighScores *scores) : fd{fd}, session{scores} {}
+
+  int fd;
+  size_t index = 0;  // position in the worker's client list
+  Session session;
+  Session::State state = Session::kTitle;  // as of the last arm()
+  uint64_t next_tick = 0;  // when the next simulation tick is due, in ns
+  Telnet telnet;
+  KeyDecoder keys;
+  Framebuffer screen;  // what the client's terminal shows
+  Output out;
+  msghdr message;  // describes the send in flight on the io_uring
+  bool touched = false, writing = false, closed = false, skipped = false;
+  bool sending = false;
+  bool congested = false;  // frames dropped since the last adapt()
+  int quality = 0, calm = 0;  // index into kQualities, and clean checks
+  uint32_t min_rtt = UINT32_MAX;  // shortest smoothed round trip, in us
+  uint64_t frame = 0, adapt_at = 0;  // frames played, and next check
+};
+
+/* A screen that looks the same for every session with the same board
+ * size, encoded once (onto a cleared terminal) for all of them.
+ */
+struct SharedScreen {
+  SharedScreen(int width, int height) : display{width, height} {}
+
+  Display display;
+  Framebuffer framebuffer;  // the terminal, once the bytes are sent
+  Shared bytes;
+};
+
+/* The title screen of a fresh session. */
+static const SharedScreen &title_screen(int width, int height) {
+  static std::mutex lock;
+  static std::map<std::pair<int, int>, std::unique_ptr<SharedScreen>> cache;
+  std::lock_guard<std::mutex> guard{lock};
+  std::unique_ptr<SharedScreen> &screen = cache[std::make_pair(width, height)];
+  if (!screen) {
+    screen.reset(new SharedScreen{width, height});
+    draw_title(screen->display, Game{width, height});
+    std::string bytes;
+    screen->framebuffer.update(screen->display.screen, bytes);
+    screen->bytes = std::make_shared<const std::string>(std::move(bytes));
+  }
+  return *screen;
+}
+
+/* Counters for one shard, written by its worker and read by report(). */
+struct Stats {
+  std::atomic<int> sessions{0};
+  std::atomic<uint64_t> ticks{0}, frames{0}, skipped{0}, passes{0};
+  std::atomic<uint64_t> bytes{0}, wire{0}, encode_ns{0}, syscalls{0};
+  std::atomic<uint64_t> sgr_sent{0};
+  std::atomic<int64_t> sgr_saved{0};
+  std::atomic<uint64_t> pass_ns{0}, pass_max_ns{0}, busy_ns{0};
+  std::atomic<uint64_t> stolen{0}, donated{0}, resyncs{0};
+  std::atomic<uint64_t> lowered{0}, raised{0};
+  Histogram lateness;
+};
+
+class Server::Worker {
+ public:
+  Worker(Server *server, int index);
+  ~Worker();
+
+  void start() { thread_ = std::thread{&Worker::run, this}; }
+  void join() { thread_.join(); }
+  void adopt(std::vector<Client *> &clients);
+  bool uring() const { return uring_; }
+
+  Stats stats;
+  std::atomic<int> thief{-1};
+
+ private:
+  void run();
+  void accept();
+  void receive(Client *client);
+  void input(Client *client, unsigned char *buf, ssize_t n);
+  void render(Client *client);
+  void flush(Client *client);
+  void flushed(Client *client, bool ok);
+  void close(Client *client);
+  void fire(Timer *timer);
+  void touch(Client *client);
+  void arm(Client *client);
+  void adapt(Client *client);
+  void pass();
+  void watch(Client *client, int op);
+  void steal();
+  void donate();
+  io_uring_sqe *request(uint64_t data);
+  void complete();
+
+  /* Tags in the low bit of a ring request's user data, above which is
+   * the client for a send or the read buffer's index for a receive.
+   */
+  enum : uint64_t { kReceive, kSend };
+
+  Server *server_;
+  int index_, epoll_fd_, wake_fd_, timer_fd_;
+  uint64_t calls_ = 0;  // system calls since the last pass was counted
+  Ring ring_;
+  bool uring_;
+  std::unique_ptr<unsigned char[]> buffers_;  // kMaxEvents reads' worth
+  Client *reading_[kMaxEvents];
+  uint64_t armed_ = TimingWheel::kNever;
+  std::vector<std::unique_ptr<Client>> clients_;
+  std::vector<Client *> touched_;
+  TimingWheel wheel_;
+  Timer balance_;
+  std::mutex inbox_lock_;
+  std::vector<Client *> inbox_;
+  std::thread thread_;
+};
+
+Server::Worker::Worker(Server *server, int index)
+    : server_{server}, index_{index}, wheel_{server->ticks(server->clock())} {
+  epoll_fd_ = epoll_create1(0);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  epoll_event event = {EPOLLIN | EPOLLEXCLUSIVE, {nullptr}};
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server->listen_fd_, &event);
+  event = {EPOLLIN, {this}};
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+  event = {EPOLLIN, {&timer_fd_}};
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event);
+  wheel_.schedule(&balance_, wheel_.now() + kBalancePeriod);
+  uring_ = server->uring_ && ring_.setup(kRingEntries) &&
+           ring_.supports(IORING_OP_RECV) &&
+           ring_.supports(IORING_OP_SENDMSG);
+  if (uring_) buffers_.reset(new unsigned char[kMaxEvents * kReadSize]);
+}
+
+Server::Worker::~Worker() {
+  for (auto &client : clients_) ::close(client->fd);
+  for (Client *client : inbox_) {
+    ::close(client->fd);
+    delete client;
+  }
+  ::close(epoll_fd_);
+  ::close(wake_fd_);
+  ::close(timer_fd_);
+}
+
+void Server::Worker::watch(Client *client, int op) {
+  calls_++;
+  epoll_event event = {EPOLLIN | (client->writing ? EPOLLOUT : 0u), {client}};
+  epoll_ctl(epoll_fd_, op, client->fd, &event);
+}
+
+void Server::Worker::accept() {
+  int fd;
+  while ((fd = accept4(server_->listen_fd_, nullptr, nullptr,
+                       SOCK_NONBLOCK)) >= 0) {
+    calls_ += 3;  // with the two socket options below
+    setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &kUnsentLimit,
+               sizeof(kUnsentLimit));
+    /* Each frame goes out in one write, so Nagle's algorithm would only
+     * hold it back until the last frame is acknowledged.
+     */
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    Client *client = new Client{fd, server_->scores_};
+    client->index = clients_.size();
+    clients_.emplace_back(client);
+    watch(client, EPOLL_CTL_ADD);
+    client->out.tail() = Telnet::kHello;
+    if (server_->compress_ >= 0) {
+      client->telnet.offer_compression(client->out.tail());
+    }
+    arm(client);
+    touch(client);
+  }
+  calls_++;  // the accept4() that came up empty
+}
+
+void Server::Worker::receive(Client *client) {
+  unsigned char buf[kReadSize];
+  calls_++;
+  ssize_t n = read(client->fd, buf, sizeof(buf));
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+  input(client, buf, n);
+}
+
+/* Handle the result N of reading BUF from the client. */
+void Server::Worker::input(Client *client, unsigned char *buf, ssize_t n) {
+  if (n <= 0) {
+    client->session.key(kKeyHangup);
+    client->closed = true;
+    touch(client);
+    return;
+  }
+  n = client->telnet.filter(buf, n, client->out.tail());
+  if (client->telnet.compressing()) {
+    client->out.tail() += Telnet::kCompress;
+    if (!client->out.compress(Output::Flush(server_->compress_))) {
+      client->closed = true;
+      touch(client);
+      return;
+    }
+  }
+  if (client->telnet.uncompressing()) client->out.uncompress();
+  if (client->telnet.resized()) {
+    client->session.window(client->telnet.cols, client->telnet.rows);
+    touch(client);
+  }
+  for (ssize_t i = 0; i < n; i++) {
+    int c = client->keys.decode(buf[i]);
+    if (c != kNoKey) {
+      client->session.key(c);
+      bool playing = client->session.state == Session::kPlay;
+      if (!playing || client->state != Session::kPlay) {
+        touch(client);  // otherwise it shows up in the next frame
+      }
+    }
+  }
+  if (!client->touched) flush(client);  // else it goes with the frame
+}
+
+/* Arm the client's timer for whatever its session is waiting on: the
+ * next frame while playing, otherwise an inactivity timeout.
+ */
+void Server::Worker::arm(Client *client) {
+  client->state = client->session.state;
+  uint64_t now = wheel_.now();
+  switch (client->state) {
+    case Session::kPlay:
+      client->next_tick = server_->deadline_ns(now);
+      wheel_.schedule(client, now);
+      break;
+    case Session::kName:
+      wheel_.schedule(client, now + kNameTimeout);
+      break;
+    case Session::kTitle:
+    case Session::kRetry:
+      wheel_.schedule(client, now + kIdleTimeout);
+      break;
+    case Session::kQuit:
+      wheel_.cancel(client);
+      client->closed = true;
+      break;
+  }
+}
+
+/* Note that the client needs rendering (or closing) in this pass. */
+void Server::Worker::touch(Client *client) {
+  if (client->session.state != client->state) arm(client);
+  if (!client->touched) {
+    client->touched = true;
+    touched_.push_back(client);
+  }
+}
+
+void Server::Worker::fire(Timer *timer) {
+  if (timer == &balance_) {
+    donate();
+    steal();
+    wheel_.schedule(&balance_, timer->deadline + kBalancePeriod);
+    return;
+  }
+  Client *client = static_cast<Client *>(timer);
+  switch (client->state) {
+    case Session::kPlay: {
+      /* Run the simulation ticks due by this frame's deadline. */
+      uint64_t frame = server_->deadline_ns(client->deadline);
+      uint64_t tick = server_->tick_ns_, period = server_->frame_ticks_;
+      for (int i = 0; client->next_tick <= frame; i++) {
+        if (i == server_->max_ticks_) {
+          client->next_tick = frame + tick;
+          break;
+        }
+        client->session.tick();
+        client->next_tick += tick;
+        stats.ticks.fetch_add(1, std::memory_order_relaxed);
+      }
+      uint64_t now = server_->clock();
+      stats.lateness.add(now - frame);
+      if (client->session.state == Session::kPlay) {
+        uint64_t next = client->deadline + period;
+        if (server_->ticks(now) > next + kMaxLag * period) {
+          next = wheel_.now() + period;
+          client->next_tick = server_->deadline_ns(next);
+          stats.resyncs.fetch_add(1, std::memory_order_relaxed);
+        }
+        wheel_.schedule(client, next);
+        if (wheel_.now() >= client->adapt_at) adapt(client);
+        /* Between the frames a slow client is sent, only simulate. */
+        if (++client->frame % kQualities[client->quality].stride) return;
+      }
+      break;
+    }
+    case Session::kName:
+      client->session.key('\r');
+      break;
+    default:
+      client->closed = true;
+  }
+  touch(client);
+}
+
+/* Check whether the client's connection keeps up with its frames, and
+ * move its quality down a level if not, or back up once it has for a
+ * while.
+ */
+void Server::Worker::adapt(Client *client) {
+  client->adapt_at = wheel_.now() + kAdaptPeriod;
+  bool slow = client->congested || client->out.pending() > 0;
+  client->congested = false;
+  tcp_info info;
+  socklen_t size = sizeof(info);
+  calls_++;
+  if (getsockopt(client->fd, IPPROTO_TCP, TCP_INFO, &info, &size) == 0 &&
+      info.tcpi_rtt) {
+    client->min_rtt = std::min(client->min_rtt, info.tcpi_rtt);
+    slow = slow || info.tcpi_rtt - client->min_rtt > kMaxQueueing;
+  }
+  int quality = client->quality;
+  if (slow) {
+    client->calm = 0;
+    quality = std::min(quality + 1, kLowest);
+  } else if (++client->calm >= kCalmChecks) {
+    client->calm = 0;
+    quality = std::max(quality - 1, 0);
+  }
+  if (quality > client->quality) {
+    stats.lowered.fetch_add(1, std::memory_order_relaxed);
+  } else if (quality < client->quality) {
+    stats.raised.fetch_add(1, std::memory_order_relaxed);
+  }
+  client->quality = quality;
+  client->screen.mask(kQualities[quality].attrs);
+}
+
+/* Draw the client's current frame, unless its connection is still
+ * busy with an earlier one. Then the frame is dropped, and once the
+ * connection drains the latest frame is sent as a diff against the
+ * last one that went out, so at most one frame is ever queued.
+ */
+void Server::Worker::render(Client *client) {
+  client->skipped = false;
+  if (client->writing) {
+    client->skipped = true;
+    client->congested = true;
+    stats.skipped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  client->session.draw();
+  Display &display = client->session.display;
+  size_t size = client->out.pending();
+  uint64_t start = server_->clock();
+  if (client->state == Session::kTitle && client->quality == 0 &&
+      !client->screen.shows(display.screen)) {
+    const SharedScreen &title = title_screen(display.width, display.height);
+    if (title.framebuffer.shows(display.screen)) {
+      client->out.share(title.bytes);
+      client->screen = title.framebuffer;
+      display.screen.clean();
+    }
+  }
+  client->screen.update(display.screen, client->out.tail());
+  stats.encode_ns.fetch_add(server_->clock() - start,
+                            std::memory_order_relaxed);
+  stats.bytes.fetch_add(client->out.pending() - size,
+                        std::memory_order_relaxed);
+  stats.sgr_sent.fetch_add(client->screen.sgr_sent, std::memory_order_relaxed);
+  stats.sgr_saved.fetch_add(client->screen.sgr_saved,
+                            std::memory_order_relaxed);
+  client->screen.sgr_sent = client->screen.sgr_saved = 0;
+  stats.frames.fetch_add(1, std::memory_order_relaxed);
+  flush(client);
+}
+
+/* Send the client's pending output: right away through epoll, or
+ * queued on the io_uring to go out with the rest of the pass's.
+ */
+void Server::Worker::flush(Client *client) {
+  if (!uring_ || !client->out.pending()) {
+    bool ok = client->out.write(client->fd);
+    calls_ += client->out.calls;
+    client->out.calls = 0;
+    flushed(client, ok);
+  } else if (!client->sending) {
+    uint64_t data = reinterpret_cast<uintptr_t>(client) << 1 | kSend;
+    io_uring_sqe *sqe = request(data);
+    int flags = client->out.gather(client->message);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = client->fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(&client->message);
+    sqe->msg_flags = flags;
+    client->sending = true;
+  }
+}
+
+/* Follow up on writing the client's output, which failed unless OK. */
+void Server::Worker::flushed(Client *client, bool ok) {
+  stats.wire.fetch_add(client->out.written, std::memory_order_relaxed);
+  client->out.written = 0;
+  if (!ok) {
+    client->closed = true;
+    touch(client);
+    return;
+  }
+  size_t backlog = client->out.pending();
+  bool pending = backlog > 0;
+  if (!pending) {
+    if (client->skipped) touch(client);
+  } else if (backlog > kMaxBacklog) {
+    client->closed = true;
+    touch(client);
+    return;
+  }
+  if (pending != client->writing) {
+    client->writing = pending;
+    watch(client, EPOLL_CTL_MOD);
+  }
+}
+
+void Server::Worker::close(Client *client) {
+  client->out.tail() += "\x1b[0m\x1b[?25h\r\n";
+  client->out.write(client->fd);
+  ::close(client->fd);
+  wheel_.cancel(client);
+  size_t index = client->index;
+  clients_[index] = std::move(clients_.back());
+  clients_[index]->index = index;
+  clients_.pop_back();
+}
+
+/* Render or close every client touched since the last pass. A client
+ * stays marked as touched until it is done with, so that a failed write
+ * during render() can't queue it a second time and have the later entry
+ * point at a client close() has already freed.
+ */
+void Server::Worker::pass() {
+  for (size_t i = 0; i < touched_.size(); i++) {
+    Client *client = touched_[i];
+    if (!client->closed) render(client);
+    if (client->closed && client->sending) complete();
+    if (client->closed) {
+      close(client);
+    } else {
+      client->touched = false;
+    }
+  }
+  touched_.clear();
+  stats.sessions.store(clients_.size(), std::memory_order_relaxed);
+}
+
+/* Ask the busiest shard to hand over some sessions when it carries
+ * noticeably more than this one. The victim answers in donate() from
+ * its own thread, so a session is never touched by two threads.
+ */
+void Server::Worker::steal() {
+  int mine = stats.sessions.load(std::memory_order_relaxed);
+  Worker *victim = nullptr;
+  int most = mine + kImbalance - 1;
+  for (auto &worker : server_->workers_) {
+    int load = worker->stats.sessions.load(std::memory_order_relaxed);
+    if (load > most) {
+      victim = worker.get();
+      most = load;
+    }
+  }
+  int none = -1;
+  if (victim) victim->thief.compare_exchange_strong(none, index_);
+}
+
+void Server::Worker::donate() {
+  int index = thief.exchange(-1);
+  if (index < 0) return;
+  Worker *worker = server_->workers_[index].get();
+  int theirs = worker->stats.sessions.load(std::memory_order_relaxed);
+  int count = (static_cast<int>(clients_.size()) - theirs) / 2;
+  std::vector<Client *> moving;
+  for (int i = 0; i < count; i++) {
+    Client *client = clients_.back().get();
+    if (client->touched) break;  // has output due in this pass
+    clients_.back().release();
+    clients_.pop_back();
+    wheel_.cancel(client);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client->fd, nullptr);
+    moving.push_back(client);
+  }
+  if (moving.empty()) return;
+  stats.sessions.store(clients_.size(), std::memory_order_relaxed);
+  stats.donated.fetch_add(moving.size(), std::memory_order_relaxed);
+  worker->adopt(moving);
+}
+
+/* Called from another worker's thread to hand over sessions. Their
+ * deadlines are absolute, so the timers carry over unchanged.
+ */
+void Server::Worker::adopt(std::vector<Client *> &clients) {
+  {
+    std::lock_guard<std::mutex> lock{inbox_lock_};
+    inbox_.insert(inbox_.end(), clients.begin(), clients.end());
+  }
+  uint64_t one = 1;
+  if (write(wake_fd_, &one, sizeof(one)) < 0) perror("flappy: eventfd");
+}
+
+/* A ring request carrying DATA, submitting the queued ones first if
+ * the ring is full.
+ */
+io_uring_sqe *Server::Worker::request(uint64_t data) {
+  io_uring_sqe *sqe = ring_.prepare();
+  if (!sqe) {
+    complete();
+    sqe = ring_.prepare();
+  }
+  sqe->user_data = data;
+  return sqe;
+}
+
+/* Submit every queued ring request in one system call, and handle the
+ * results, which come back before it returns since every socket is
+ * non-blocking.
+ */
+void Server::Worker::complete() {
+  while (ring_.queued()) {
+    if (!ring_.submit()) {
+      perror("flappy: io_uring_enter");
+      exit(EXIT_FAILURE);
+    }
+    ring_.reap([this](const io_uring_cqe &cqe) {
+      int error = cqe.res < 0 ? -cqe.res : 0;
+      if ((cqe.user_data & 1) == kSend) {
+        Client *client = reinterpret_cast<Client *>(cqe.user_data >> 1);
+        client->sending = false;
+        if (!error) client->out.consume(cqe.res);
+        flushed(client, !error || error == EAGAIN || error == EINTR);
+      } else if (error != EAGAIN && error != EINTR) {
+        size_t slot = cqe.user_data >> 1;
+        input(reading_[slot], &buffers_[slot * kReadSize], cqe.res);
+      }
+    });
+  }
+  calls_ += ring_.calls;
+  ring_.calls = 0;
+}
+
+void Server::Worker::run() {
+  epoll_event events[kMaxEvents];
+  while (true) {
+    uint64_t next = wheel_.next_deadline();
+    if (next != armed_) {
+      itimerspec spec = {};
+      if (next != TimingWheel::kNever) {
+        spec.it_value = to_timespec(server_->deadline_ns(next));
+      }
+      calls_++;
+      timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+      armed_ = next;
+    }
+    /* Results of the last pass's sends may have touched clients. */
+    calls_++;
+    int timeout = touched_.empty() ? -1 : 0;
+    int n = epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
+    uint64_t awake = server_->clock();
+    if (n < 0 && errno != EINTR) {
+      perror("flappy: epoll_wait");
+      return;
+    }
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == nullptr) {
+        accept();
+        continue;
+      } else if (ptr == &timer_fd_) {
+        uint64_t expirations;
+        calls_++;
+        if (read(timer_fd_, &expirations, sizeof(expirations)) < 0) continue;
+        armed_ = TimingWheel::kNever;
+        continue;
+      } else if (ptr == this) {
+        uint64_t count;
+        calls_++;
+        if (read(wake_fd_, &count, sizeof(count)) < 0) continue;
+        std::lock_guard<std::mutex> lock{inbox_lock_};
+        for (Client *client : inbox_) {
+          client->index = clients_.size();
+          clients_.emplace_back(client);
+          watch(client, EPOLL_CTL_ADD);
+          wheel_.schedule(client, client->deadline);
+          touch(client);
+        }
+        stats.stolen.fetch_add(inbox_.size(), std::memory_order_relaxed);
+        inbox_.clear();
+        continue;
+      }
+      Client *client = static_cast<Client *>(ptr);
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        if (uring_) {
+          reading_[i] = client;
+          io_uring_sqe *sqe = request(uint64_t(i) << 1 | kReceive);
+          sqe->opcode = IORING_OP_RECV;
+          sqe->fd = client->fd;
+          sqe->addr = reinterpret_cast<uintptr_t>(&buffers_[i * kReadSize]);
+          sqe->len = kReadSize;
+        } else {
+          receive(client);
+        }
+      }
+      if (events[i].events & EPOLLOUT) flush(client);
+    }
+    if (uring_) complete();
+
+    uint64_t start = server_->clock();
+    wheel_.advance(server_->ticks(start), [this](Timer *timer) { fire(timer); });
+    pass();
+    if (uring_) complete();
+    stats.syscalls.fetch_add(calls_, std::memory_order_relaxed);
+    stats.passes.fetch_add(1, std::memory_order_relaxed);
+    calls_ = 0;
+    uint64_t end = server_->clock();
+    uint64_t ns = end - start;
+    stats.pass_ns.fetch_add(ns, std::memory_order_relaxed);
+    if (ns > stats.pass_max_ns.load(std::memory_order_relaxed)) {
+      stats.pass_max_ns.store(ns, std::memory_order_relaxed);
+    }
+    stats.busy_ns.fetch_add(end - awake, std::memory_order_relaxed);
+  }
+}
+
+Server::Server(const char *host, const char *port, HighScores *scores,
+               int threads, int interval, Rates rates, bool uring,
+               int compress)
+    : host_{host},
+      port_{port},
+      scores_{scores},
+      threads_{threads},
+      interval_{interval},
+      uring_{uring},
+      compress_{compress},
+      tick_ns_(rates.tick.count()),
+      frame_ticks_(std::max<uint64_t>(1, rates.frame.count() / 1000000)),
+      max_ticks_{rates.max_ticks()},
+      epoch_{monotonic_ns()} {}
+
+Server::~Server() {
+  workers_.clear();
+  if (listen_fd_ >= 0) ::close(listen_fd_);
+}
+
+bool Server::listen() {
+  addrinfo hints, *info;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  int err = getaddrinfo(host_, port_, &hints, &info);
+  if (err != 0) {
+    fprintf(stderr, "flappy: %s:%s: %s\n", host_, port_, gai_strerror(err));
+    return false;
+  }
+  for (addrinfo *ai = info; ai && listen_fd_ < 0; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK,
+                    ai->ai_protocol);
+    if (fd < 0) continue;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+        ::listen(fd, SOMAXCONN) == 0) {
+      listen_fd_ = fd;
+    } else {
+      ::close(fd);
+    }
+  }
+  freeaddrinfo(info);
+  if (listen_fd_ < 0) {
+    fprintf(stderr, "flappy: %s:%s: %s\n", host_, port_, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+/* Print one line per shard covering the last interval. */
+void Server::report() {
+  double period = interval_ * 1e9;
+  for (size_t i = 0; i < workers_.size(); i++) {
+    Stats &s = workers_[i]->stats;
+    uint64_t ticks = s.ticks.exchange(0, std::memory_order_relaxed);
+    uint64_t frames = s.frames.exchange(0, std::memory_order_relaxed);
+    uint64_t skipped = s.skipped.exchange(0, std::memory_order_relaxed);
+    uint64_t pass = s.pass_ns.exchange(0, std::memory_order_relaxed);
+    uint64_t max = s.pass_max_ns.exchange(0, std::memory_order_relaxed);
+    uint64_t busy = s.busy_ns.exchange(0, std::memory_order_relaxed);
+    uint64_t bytes = s.bytes.exchange(0, std::memory_order_relaxed);
+    uint64_t wire = s.wire.exchange(0, std::memory_order_relaxed);
+    uint64_t encode = s.encode_ns.exchange(0, std::memory_order_relaxed);
+    uint64_t sgr_sent = s.sgr_sent.exchange(0, std::memory_order_relaxed);
+    int64_t sgr_saved = s.sgr_saved.exchange(0, std::memory_order_relaxed);
+    uint64_t syscalls = s.syscalls.exchange(0, std::memory_order_relaxed);
+    uint64_t passes = s.passes.exchange(0, std::memory_order_relaxed);
+    double per = frames ? 1.0 / frames : 0.0;
+    fprintf(stderr,
+            "flappy: shard %zu: %d sessions (%.0f playing), %.1f%% busy, "
+            "%llu ticks, %llu frames at %.1fus (%llu dropped), "
+            "pass max %.0fus, stole %llu, gave %llu\n",
+            i, s.sessions.load(), ticks * tick_ns_ / period,
+            busy / period * 100, (unsigned long long)ticks,
+            (unsigned long long)frames, pass / 1e3 * per,
+            (unsigned long long)skipped, max / 1e3,
+            (unsigned long long)s.stolen.exchange(0),
+            (unsigned long long)s.donated.exchange(0));
+    fprintf(stderr,
+            "flappy: shard %zu: %.0f bytes per frame (%.0f sent), "
+            "encoded in %.0fns, "
+            "%.1f SGR sequences per frame saving %.0f bytes, "
+            "%.2f system calls per frame and %.1f per pass (%s)\n",
+            i, bytes * per, wire * per, encode * per, sgr_sent * per, sgr_saved * per,
+            syscalls * per, passes ? (double)syscalls / passes : 0.0,
+            workers_[i]->uring() ? "io_uring" : "epoll");
+    fprintf(stderr, "flappy: shard %zu: ", i);
+    s.lateness.report(stderr);
+    fprintf(stderr, ", %llu resyncs, quality lowered %llu and raised %llu\n",
+            (unsigned long long)s.resyncs.exchange(0),
+            (unsigned long long)s.lowered.exchange(0),
+            (unsigned long long)s.raised.exchange(0));
+  }
+  fprintf(stderr, "flappy: scores: ");
+  scores_->verifier().report(stderr, interval_);
+  fprintf(stderr, "\n");
+}
+
+int Server::run() {
+  if (!listen()) return 1;
+  signal(SIGPIPE, SIG_IGN);
+  for (int i = 0; i < threads_; i++) {
+    workers_.emplace_back(new Worker{this, i});
+  }
+  if (uring_ && !workers_[0]->uring()) {
+    fprintf(stderr, "flappy: io_uring unavailable, using epoll\n");
+  }
+  for (auto &worker : workers_) worker->start();
+  if (interval_ > 0) {
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::seconds{interval_});
+      report();
+    }
+  }
+  for (auto &worker : workers_) worker->join();
+  return 0;
+}
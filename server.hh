@@ -0,0 +1,50 @@
+#ifndef FLAPPY_SERVER_HH
+#define FLAPPY_SERVER_HH
+
+#include <memory>
+#include <vector>
+#include "game.hh"
+#include "highscores.hh"
+#include "pacing.hh"
+
+/* Hosts many game sessions in one process, one per TCP connection.
+ * Sessions are sharded across worker threads, each running its own
+ * epoll loop, and idle workers steal sessions from busy ones. With
+ * URING, each worker batches its socket reads and writes through an
+ * io_uring where the kernel allows. Unless COMPRESS is negative,
+ * clients are offered MCCP2 compression flushed as that Output::Flush
+ * says.
+ */
+class Server {
+ public:
+  Server(const char *host, const char *port, HighScores *scores,
+         int threads, int interval, Rates rates, bool uring, int compress);
+  ~Server();
+
+  int run();
+
+ private:
+  struct Client;
+  class Worker;
+
+  bool listen();
+  void report();
+
+  /* Worker timing wheels tick in milliseconds since startup. */
+  uint64_t clock() const { return monotonic_ns(); }
+  uint64_t ticks(uint64_t ns) const { return (ns - epoch_) / 1000000; }
+  uint64_t deadline_ns(uint64_t tick) const { return epoch_ + tick * 1000000; }
+
+  const char *host_, *port_;
+  HighScores *scores_;
+  int threads_, interval_;
+  bool uring_;
+  int compress_;
+  uint64_t tick_ns_, frame_ticks_;
+  int max_ticks_;  // Rates::max_ticks()
+  int listen_fd_ = -1;
+  uint64_t epoch_;  // CLOCK_MONOTONIC nanoseconds
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+#endif
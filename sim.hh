@@ -0,0 +1,186 @@
+/* sim.hh --- flappy bird simulation, independent of any display
+ * This is free and unencumbered software released into the public domain.
+ */
+#ifndef FLAPPY_SIM_HH
+#define FLAPPY_SIM_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Default board size. */
+constexpr int kWidth = 40, kHeight = 20;
+
+/* The heights of the N walls across the board, leftmost first, or 0
+ * where there is none. Each height is stored twice, N apart, so that
+ * the walls in view are always contiguous from the head: scrolling is
+ * an index increment and a lookup one array read. Heights must fit in
+ * a byte.
+ */
+class Walls {
+ public:
+  explicit Walls(int n) : heights_(2 * n), n_{n} {}
+
+  int size() const { return n_; }
+  int operator[](int i) const { return heights_[head_ + i]; }
+  int back() const { return heights_[head_ + n_ - 1]; }
+
+  /* Drop the leftmost wall and add HEIGHT on the right. */
+  void push(int height) {
+    heights_[head_] = heights_[head_ + n_] = height;
+    head_ = head_ + 1 < n_ ? head_ + 1 : 0;
+  }
+
+ private:
+  std::vector<uint8_t> heights_;
+  int n_, head_ = 0;
+};
+
+/* A PCG32 generator. Each game owns one, so a game's walls follow from
+ * its seed alone, whatever other games run alongside it.
+ */
+class Random {
+ public:
+  explicit Random(uint64_t seed) {
+    next();
+    state_ += seed;
+    next();
+  }
+
+  uint32_t next() {
+    uint64_t x = state_;
+    state_ = x * 0x5851f42d4c957f2d + 0x14057b7ef767814f;
+    uint32_t xorshifted = ((x >> 18) ^ x) >> 27;
+    int rot = x >> 59;
+    return (xorshifted >> rot) | (xorshifted << (-rot & 31));
+  }
+
+  /* A number in [0, N). */
+  int below(int n) { return (uint64_t)next() * n >> 32; }
+
+ private:
+  uint64_t state_ = 0;
+};
+
+struct World {
+  World(int width, int height, uint64_t seed = 0)
+      : width{width}, height{height}, seed{seed}, walls{width - 2},
+        random{seed} {}
+
+  const int width, height;
+  const uint64_t seed;  // plays the same walls again
+  Walls walls;
+  Random random;
+  int steps = 0;
+  int scrolled = 0;  // columns the walls have moved left so far
+
+  constexpr static int kRate = 2, kVGap = 2, kHGap = 10;
+
+  /* The height of a new wall on a board HEIGHT rows high. */
+  static int rand_wall(Random &random, int height) {
+    int h = height;
+    return random.below(h) / 2 + h / 4;
+  }
+
+  int rand_wall() { return rand_wall(random, height); }
+
+  void step() {
+    steps++;
+    if (steps % kRate == 0) {
+      scrolled++;
+      switch (steps % (kRate * kHGap)) {
+        case 0:
+          walls.push(rand_wall());
+          break;
+        case kRate * 1:
+        case kRate * 2:
+          walls.push(walls.back());
+          break;
+        default:
+          walls.push(0);
+      }
+    }
+  }
+
+  /* The score once STEPS steps have been taken. */
+  static int score(int steps) {
+    return std::max(0, (steps - 2) / (kRate * kHGap) - 2);
+  }
+
+  int score() const { return score(steps); }
+};
+
+struct Bird {
+  Bird(int height) : y{height / 2.0} {}
+
+  static constexpr double kImpulse = -0.8, kGravity = 0.1;
+
+  double y, dy = kImpulse;
+
+  void gravity() {
+    dy += kGravity;
+    y += dy;
+  }
+
+  void poke() { dy = kImpulse; }
+
+  /* The board row the bird is drawn in. */
+  int row(int height) const {
+    int y = std::round(this->y);
+    return std::max(1, std::min(y, height - 2));
+  }
+
+  /* The bird flies in this column of the board. */
+  static int column(const World &world) { return world.width / 2; }
+
+  bool is_alive(const World &world) const {
+    if (y <= 0 || y >= world.height) {
+      return false;
+    }
+    int wall = world.walls[column(world) - 1];
+    if (wall != 0) {
+      return y > wall - World::kVGap && y < wall + World::kVGap;
+    }
+    return true;
+  }
+};
+
+struct Game {
+  Game(int width = kWidth, int height = kHeight, uint64_t seed = 0)
+      : bird{height}, world{width, height, seed} {}
+
+  Bird bird;
+  World world;
+
+  /* Advance the simulation one tick. Returns false once the bird has
+   * died.
+   */
+  bool update(bool poke) {
+    if (poke) bird.poke();
+    world.step();
+    bird.gravity();
+    return bird.is_alive(world);
+  }
+
+  int score() const { return world.score(); }
+};
+
+/* A simple bot: hop whenever the bird sinks more than a row below the
+ * middle of the gap it's in or approaching (or of the board, when no
+ * wall is in sight).
+ */
+inline bool autopilot(const Game &game) {
+  const World &world = game.world;
+  double target = world.height / 2.0;
+  int column = Bird::column(world) - 1;
+  for (int i = column; i < world.walls.size() && i < column + 10; i++) {
+    if (world.walls[i] != 0) {
+      target = world.walls[i];
+      break;
+    }
+  }
+  return game.bird.y > target + 1;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "telnet.hh"
+
+const char Telnet::kHello[] = {
+    char(IAC), char(WILL), char(ECHO), char(IAC), char(WILL), char(SGA),
+    char(IAC), char(DO),   char(NAWS), '\0',
+};
+
+const char Telnet::kCompress[] = {
+    char(IAC), char(SB), char(COMPRESS2), char(IAC), char(SE), '\0',
+};
+
+void Telnet::offer_compression(std::string &reply) {
+  if (compress_ != kNo) return;
+  compress_ = kWantYes;
+  reply += char(IAC);
+  reply += char(WILL);
+  reply += char(COMPRESS2);
+}
+
+size_t Telnet::filter(unsigned char *buf, size_t n, std::string &reply) {
+  size_t length = 0;
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = buf[i];
+    switch (state_) {
+      case kData:
+        if (c == IAC) {
+          state_ = kIac;
+        } else {
+          buf[length++] = c;
+        }
+        break;
+      case kIac:
+        if (c == IAC) {
+          buf[length++] = c;
+          state_ = kData;
+        } else if (c >= WILL && c <= DONT) {
+          verb_ = c;
+          state_ = kVerb;
+        } else if (c == SB) {
+          sub_length_ = 0;
+          state_ = kSub;
+        } else {
+          state_ = kData;  // NOP, AYT, GA, etc.
+        }
+        break;
+      case kVerb:
+        negotiate(verb_, c, reply);
+        state_ = kData;
+        break;
+      case kSub:
+      case kSubIac:
+        if (state_ == kSub && c == IAC) {
+          state_ = kSubIac;
+          break;
+        } else if (state_ == kSubIac && c == SE) {
+          subnegotiation();
+          state_ = kData;
+          break;
+        }
+        if (sub_length_ < sizeof(sub_)) sub_[sub_length_++] = c;
+        state_ = kSub;
+        break;
+    }
+  }
+  return length;
+}
+
+/* Option negotiation loosely follows the Q method of RFC 1143: only
+ * reply when an option actually changes state, so the two ends can't
+ * get into an endless acknowledgement loop.
+ */
+void Telnet::negotiate(unsigned char verb, unsigned char option,
+                       std::string &reply) {
+  bool ours = verb == DO || verb == DONT;
+  bool enable = verb == DO || verb == WILL;
+  Q *q = nullptr;
+  if (ours && option == ECHO) {
+    q = &echo_;
+  } else if (ours && option == SGA) {
+    q = &sga_;
+  } else if (!ours && option == NAWS) {
+    q = &naws_;
+  } else if (ours && option == COMPRESS2 && compress_ != kNo) {
+    q = &compress_;  // only once offered, and never restarted
+  }
+
+  unsigned char answer = 0;
+  if (q == nullptr) {
+    if (enable) answer = ours ? WONT : DONT;
+  } else if (enable) {
+    if (*q == kNo) answer = ours ? WILL : DO;
+    if (q == &compress_ && *q == kWantYes) compressing_ = true;
+    *q = kYes;
+  } else {
+    if (*q == kYes) answer = ours ? WONT : DONT;
+    if (q == &compress_ && *q == kYes) {
+      /* Once the stream has begun it has to be ended; before that the
+       * host need only not begin it.
+       */
+      if (compressing_) {
+        compressing_ = false;
+      } else {
+        uncompressing_ = true;
+      }
+    }
+    *q = kNo;
+  }
+  if (answer != 0) {
+    reply += char(IAC);
+    reply += char(answer);
+    reply += char(option);
+  }
+}
+
+void Telnet::subnegotiation() {
+  if (sub_length_ == 5 && sub_[0] == NAWS) {
+    cols = sub_[1] << 8 | sub_[2];
+    rows = sub_[3] << 8 | sub_[4];
+    resized_ = true;
+  }
+}
+
+bool Telnet::resized() {
+  bool result = resized_;
+  resized_ = false;
+  return result;
+}
+
+bool Telnet::compressing() {
+  bool result = compressing_;
+  compressing_ = false;
+  return result;
+}
+
+bool Telnet::uncompressing() {
+  bool result = uncompressing_;
+  uncompressing_ = false;
+  return result;
+}
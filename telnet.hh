@@ -0,0 +1,65 @@
+#ifndef FLAPPY_TELNET_HH
+#define FLAPPY_TELNET_HH
+
+#include <string>
+#include <cstddef>
+
+/* Server side of the telnet protocol. Input is parsed incrementally, so
+ * commands may straddle reads, and is filtered in place: only the
+ * user's keystrokes remain in the buffer afterwards.
+ */
+class Telnet {
+ public:
+  enum : unsigned char {
+    IAC = 255, DONT = 254, DO = 253, WONT = 252, WILL = 251,
+    SB = 250, SE = 240,
+    ECHO = 1, SGA = 3, NAWS = 31, COMPRESS2 = 86,
+  };
+
+  /* Negotiation to send on connect: character mode with the server
+   * echoing (nothing), plus window size reports.
+   */
+  static const char kHello[];
+
+  /* Sent once the client agrees to MCCP2: everything after it is one
+   * zlib stream.
+   */
+  static const char kCompress[];
+
+  /* Offer MCCP2 output compression, appending the offer to REPLY. */
+  void offer_compression(std::string &reply);
+
+  /* Strip telnet commands from the N bytes at BUF, returning the number
+   * of data bytes left at the front of BUF. Negotiation replies are
+   * appended to REPLY.
+   */
+  size_t filter(unsigned char *buf, size_t n, std::string &reply);
+
+  /* True once if a new window size arrived since the last call. */
+  bool resized();
+
+  /* True once when the client accepts compression. */
+  bool compressing();
+
+  /* True once when the client turns compression off after accepting
+   * it. The compressed stream must then be ended.
+   */
+  bool uncompressing();
+
+  int cols = 0, rows = 0;
+
+ private:
+  enum Q : unsigned char { kNo, kYes, kWantYes };
+
+  void negotiate(unsigned char verb, unsigned char option, std::string &reply);
+  void subnegotiation();
+
+  enum { kData, kIac, kVerb, kSub, kSubIac } state_ = kData;
+  unsigned char verb_ = 0;
+  unsigned char sub_[5];
+  size_t sub_length_ = 0;
+  Q echo_ = kWantYes, sga_ = kWantYes, naws_ = kWantYes, compress_ = kNo;
+  bool resized_ = false, compressing_ = false, uncompressing_ = false;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef FLAPPY_TIMER_HH
+#define FLAPPY_TIMER_HH
+
+#include <algorithm>
+#include <cstdint>
+
+/* An intrusive timer node. Embed (or inherit) it in whatever the timer
+ * belongs to; the wheel never allocates.
+ */
+struct Timer {
+  Timer *next = nullptr, *prev = nullptr;
+  uint64_t deadline = 0;
+
+  bool pending() const { return next != nullptr; }
+
+  void unlink() {
+    if (next) {
+      prev->next = next;
+      next->prev = prev;
+      next = prev = nullptr;
+    }
+  }
+};
+
+/* Hierarchical timing wheel over absolute deadlines measured in ticks.
+ * Scheduling and cancelling are O(1), and each timer is cascaded down
+ * at most once per level before it fires. Four levels of 64 slots
+ * cover 2^24 ticks; anything further out parks in the top level and
+ * is re-examined when that slot comes around.
+ */
+class TimingWheel {
+ public:
+  static constexpr int kBits = 6, kSlots = 1 << kBits, kLevels = 4;
+  static constexpr uint64_t kNever = UINT64_MAX;
+
+  explicit TimingWheel(uint64_t now = 0) : now_{now} {
+    for (auto &level : slots_) {
+      for (Timer &head : level) head.next = head.prev = &head;
+    }
+  }
+
+  uint64_t now() const { return now_; }
+  int size() const { return size_; }
+
+  /* (Re)arm TIMER for the absolute tick DEADLINE. Deadlines already in
+   * the past fire on the next tick.
+   */
+  void schedule(Timer *timer, uint64_t deadline) {
+    cancel(timer);
+    timer->deadline = deadline;
+    insert(timer, deadline > now_ ? deadline : now_ + 1);
+    size_++;
+  }
+
+  void cancel(Timer *timer) {
+    if (timer->pending()) {
+      timer->unlink();
+      size_--;
+    }
+  }
+
+  /* Advance the wheel to tick NOW, calling FIRE(timer) for every timer
+   * that comes due, tick by tick. FIRE may reschedule the timer
+   * it is given and schedule or cancel any other.
+   */
+  template <typename F>
+  void advance(uint64_t now, F fire) {
+    while (now_ < now) {
+      uint64_t t = ++now_;
+      for (int level = 1; level < kLevels; level++) {
+        if (t & ((uint64_t{1} << (kBits * level)) - 1)) break;
+        cascade(level, t >> (kBits * level) & (kSlots - 1));
+      }
+      Timer due;
+      due.next = due.prev = &due;
+      splice(&slots_[0][t & (kSlots - 1)], &due);
+      while (due.next != &due) {
+        Timer *timer = due.next;
+        timer->unlink();
+        size_--;
+        fire(timer);
+      }
+    }
+  }
+
+  /* A tick no later than the earliest pending deadline, or kNever.
+   * Each level's first occupied slot bounds the timers in that level,
+   * but a higher level may hold an earlier timer than a lower one, so
+   * the bound is the least over all levels.
+   */
+  uint64_t next_deadline() const {
+    if (size_ == 0) return kNever;
+    uint64_t next = kNever;
+    for (int i = 1; i <= kSlots; i++) {
+      uint64_t t = now_ + i;
+      const Timer &head = slots_[0][t & (kSlots - 1)];
+      if (head.next != &head) {
+        next = t;
+        break;
+      }
+    }
+    for (int level = 1; level < kLevels; level++) {
+      int shift = kBits * level;
+      for (int i = 1; i <= kSlots; i++) {
+        uint64_t block = (now_ >> shift) + i;
+        const Timer &head = slots_[level][block & (kSlots - 1)];
+        if (head.next != &head) {
+          next = std::min(next, block << shift);
+          break;
+        }
+      }
+    }
+    return next == kNever ? now_ + 1 : next;
+  }
+
+ private:
+  /* File TIMER to fire at tick AT, which is never before now_. Only a
+   * cascade files a timer for the current tick, just before that tick's
+   * slot fires.
+   */
+  void insert(Timer *timer, uint64_t at) {
+    uint64_t delta = at - now_;
+    int level = 0;
+    while (level < kLevels - 1 && delta >> (kBits * (level + 1))) level++;
+    if (delta >> (kBits * kLevels)) {
+      at = now_ + (uint64_t{1} << (kBits * kLevels)) - 1;
+    }
+    Timer &head = slots_[level][at >> (kBits * level) & (kSlots - 1)];
+    timer->prev = head.prev;
+    timer->next = &head;
+    head.prev->next = timer;
+    head.prev = timer;
+  }
+
+  void cascade(int level, uint64_t slot) {
+    Timer moving;
+    moving.next = moving.prev = &moving;
+    splice(&slots_[level][slot], &moving);
+    while (moving.next != &moving) {
+      Timer *timer = moving.next;
+      timer->unlink();
+      insert(timer, timer->deadline);
+    }
+  }
+
+  static void splice(Timer *from, Timer *to) {
+    if (from->next == from) return;
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    from->next = from->prev = from;
+  }
+
+  Timer slots_[kLevels][kSlots];
+  uint64_t now_;
+  int size_ = 0;
+};
+
+#endif
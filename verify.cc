@@ -0,0 +1,88 @@
+#include "pacing.hh"
+#include "replay.hh"
+#include "verify.hh"
+
+Verifier::Verifier(int threads, std::function<void(const Claim &)> accept)
+    : accept_{std::move(accept)} {
+  for (int i = 0; i < threads; i++) {
+    threads_.emplace_back([this] { run(); });
+  }
+}
+
+Verifier::~Verifier() {
+  {
+    std::lock_guard<std::mutex> lock{lock_};
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto &thread : threads_) thread.join();
+}
+
+void Verifier::submit(Claim claim) {
+  claim.queued_ns = monotonic_ns();
+  if (threads_.empty()) {
+    check(claim);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock{lock_};
+    queue_.push_back(std::move(claim));
+  }
+  ready_.notify_one();
+}
+
+void Verifier::drain() {
+  std::unique_lock<std::mutex> lock{lock_};
+  idle_.wait(lock, [this] { return queue_.empty() && !checking_; });
+}
+
+/* Check queued claims until told to stop and the queue is empty. */
+void Verifier::run() {
+  std::unique_lock<std::mutex> lock{lock_};
+  while (true) {
+    ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) return;
+    Claim claim = std::move(queue_.front());
+    queue_.pop_front();
+    checking_++;
+    lock.unlock();
+    check(claim);
+    lock.lock();
+    if (!--checking_ && queue_.empty()) idle_.notify_all();
+  }
+}
+
+void Verifier::check(const Claim &claim) {
+  uint64_t start = monotonic_ns();
+  bool valid = claim.score >= 0 &&
+               replay(claim.replay.data(), claim.replay.size()) == claim.score;
+  uint64_t done = monotonic_ns();
+  busy_ns_.fetch_add(done - start, std::memory_order_relaxed);
+  if (valid) {
+    accept_(claim);
+    accepted_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+  }
+  uint64_t wait = done - claim.queued_ns;
+  wait_ns_.fetch_add(wait, std::memory_order_relaxed);
+  uint64_t max = wait_max_ns_.load(std::memory_order_relaxed);
+  while (wait > max && !wait_max_ns_.compare_exchange_weak(max, wait)) {
+  }
+}
+
+void Verifier::report(FILE *out, double seconds) {
+  uint64_t accepted = accepted_.exchange(0, std::memory_order_relaxed);
+  uint64_t rejected = rejected_.exchange(0, std::memory_order_relaxed);
+  uint64_t busy = busy_ns_.exchange(0, std::memory_order_relaxed);
+  uint64_t wait = wait_ns_.exchange(0, std::memory_order_relaxed);
+  uint64_t max = wait_max_ns_.exchange(0, std::memory_order_relaxed);
+  uint64_t claims = accepted + rejected;
+  fprintf(out,
+          "verified %llu claims (%llu rejected), %.0f/s, "
+          "%.0f/s per busy core, waited %.0fus on average and %.0fus at most",
+          (unsigned long long)claims, (unsigned long long)rejected,
+          seconds > 0 ? claims / seconds : 0.0,
+          busy ? claims / (busy / 1e9) : 0.0,
+          claims ? wait / 1e3 / claims : 0.0, max / 1e3);
+}
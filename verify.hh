@@ -0,0 +1,70 @@
+/* verify.hh --- replaying claimed scores before they are believed
+ * This is free and unencumbered software released into the public domain.
+ */
+#ifndef FLAPPY_VERIFY_HH
+#define FLAPPY_VERIFY_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* A score a finished game claims, with the replay to back it up. */
+struct Claim {
+  std::string name;
+  int score;
+  std::vector<uint8_t> replay;
+  uint64_t queued_ns;  // set by Verifier::submit()
+};
+
+/* Plays claimed games again from their replays on a pool of threads,
+ * and hands the claims whose replay reaches the claimed score on to
+ * ACCEPT, from whichever thread checked them. With no threads, claims
+ * are checked within submit() itself.
+ */
+class Verifier {
+ public:
+  Verifier(int threads, std::function<void(const Claim &)> accept);
+  Verifier(const Verifier &) = delete;
+  Verifier &operator=(const Verifier &) = delete;
+
+  /* Checks the claims still queued, then stops the threads. */
+  ~Verifier();
+
+  void submit(Claim claim);
+
+  /* Wait until every claim submitted so far has been checked. */
+  void drain();
+
+  /* Print a one-line summary of the claims checked over the last
+   * SECONDS seconds: how many, how fast, and how long they waited from
+   * submission to verdict. Then clear the counts.
+   */
+  void report(FILE *out, double seconds);
+
+  /* Claims found true and false since the last report(). */
+  uint64_t accepted() const { return accepted_.load(); }
+  uint64_t rejected() const { return rejected_.load(); }
+
+ private:
+  void run();
+  void check(const Claim &claim);
+
+  std::function<void(const Claim &)> accept_;
+  std::mutex lock_;
+  std::condition_variable ready_, idle_;
+  std::deque<Claim> queue_;
+  int checking_ = 0;  // claims taken off the queue but not yet decided
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+  std::atomic<uint64_t> accepted_{0}, rejected_{0};
+  std::atomic<uint64_t> busy_ns_{0}, wait_ns_{0}, wait_max_ns_{0};
+};
+
+#endif